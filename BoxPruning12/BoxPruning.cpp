@@ -1,5 +1,730 @@
 #include "stdafx.h"
 
+#ifdef USE_EXTENDED_VALIDITY_TESTS
+// Validity tests for the other entry points of this project. Each one is checked against the brute-force version, or against a
+// brute-force version of its own semantics, on the same kind of random boxes as RunValidityTest. Called from Main.cpp.
+
+static void GenerateRandomBoxes(udword nb, AABB* boxes, udword box_size, udword range)
+{
+	for(udword i=0;i<nb;i++)
+	{
+		const float x = float(rand() & range) - float(range/2);
+		const float y = float(rand() & range) - float(range/2);
+		const float z = float(rand() & range) - float(range/2);
+		const float ex = float(rand() & (box_size-1));
+		const float ey = float(rand() & (box_size-1));
+		const float ez = float(rand() & (box_size-1));
+		boxes[i].mMin.x = x - ex;
+		boxes[i].mMin.y = y - ey;
+		boxes[i].mMin.z = z - ez;
+		boxes[i].mMax.x = x + ex;
+		boxes[i].mMax.y = y + ey;
+		boxes[i].mMax.z = z + ez;
+	}
+}
+
+static void BruteForcePairs(udword nb, const AABB* boxes, Container& pairs)
+{
+	const AABB** List = new const AABB*[nb+1];
+	for(udword i=0;i<nb;i++)
+		List[i] = &boxes[i];
+	BruteForceCompleteBoxTest(nb, List, pairs);
+	DELETEARRAY(List);
+}
+
+// Normalizes the pairs so that id0<id1, and sorts them by id0 then id1
+static void SortPairs(const Container& pairs, Container& sorted)
+{
+	static RadixSort RS;
+	static Container Keys0;
+	static Container Keys1;
+
+	sorted.Reset();
+	const udword NbPairs = pairs.GetNbEntries()>>1;
+	if(!NbPairs)
+		return;
+
+	const Pair* Entries = (const Pair*)pairs.GetEntries();
+	Keys0.Reset();
+	Keys1.Reset();
+	for(udword i=0;i<NbPairs;i++)
+	{
+		Keys0.Add(TMin(Entries[i].id0, Entries[i].id1));
+		Keys1.Add(TMax(Entries[i].id0, Entries[i].id1));
+	}
+
+	RS.Sort(Keys1.GetEntries(), NbPairs, false);
+	RS.Sort(Keys0.GetEntries(), NbPairs, false);
+	const udword* Sorted = RS.GetRanks();
+	for(udword i=0;i<NbPairs;i++)
+		sorted.Add(Keys0.GetEntry(Sorted[i])).Add(Keys1.GetEntry(Sorted[i]));
+}
+
+static bool SamePairs(const Container& pairs0, const Container& pairs1)
+{
+	static Container Sorted0;
+	static Container Sorted1;
+	SortPairs(pairs0, Sorted0);
+	SortPairs(pairs1, Sorted1);
+
+	if(Sorted0.GetNbEntries()!=Sorted1.GetNbEntries())
+		return false;
+	return !Sorted0.GetNbEntries() || !memcmp(Sorted0.GetEntries(), Sorted1.GetEntries(), Sorted0.GetNbEntries()*sizeof(udword));
+}
+
+static void CheckPairs(const char* name, udword test_index, const Container& ref, const Container& pairs)
+{
+	if(!SamePairs(ref, pairs))
+	{
+		printf("\n\nERROR: %s, test index: %d\n", name, test_index);
+		exit(0);
+	}
+}
+
+static inline_ bool PairLess(const udword* p0, const udword* p1)
+{
+	return p0[0]<p1[0] || (p0[0]==p1[0] && p0[1]<p1[1]);
+}
+
+// Expected created/deleted pairs between two sorted lists of pairs
+static void DiffSortedPairs(const Container& new_pairs, const Container& old_pairs, Container& created, Container& deleted)
+{
+	const udword NbNew = new_pairs.GetNbEntries()>>1;
+	const udword NbOld = old_pairs.GetNbEntries()>>1;
+	const udword* New = new_pairs.GetEntries();
+	const udword* Old = old_pairs.GetEntries();
+	udword i=0, j=0;
+	while(i<NbNew || j<NbOld)
+	{
+		if(j==NbOld || (i<NbNew && PairLess(New + i*2, Old + j*2)))
+		{
+			created.Add(New[i*2+0]).Add(New[i*2+1]);
+			i++;
+		}
+		else if(i==NbNew || PairLess(Old + j*2, New + i*2))
+		{
+			deleted.Add(Old[j*2+0]).Add(Old[j*2+1]);
+			j++;
+		}
+		else
+		{
+			i++;
+			j++;
+		}
+	}
+}
+
+static void TestGridBoxPruning(udword test_index, udword nb, const AABB* boxes, const Container& ref)
+{
+	Container Pairs;
+	GridBoxPruning(nb, boxes, Pairs);
+	CheckPairs("GridBoxPruning", test_index, ref, Pairs);
+}
+
+static void TestDynamicTree(udword test_index, udword nb, AABB* boxes)
+{
+	DynamicTree Tree;
+	Tree.SetMargin(float(rand() & 15));
+
+	udword* Proxies = new udword[nb+1];
+	for(udword i=0;i<nb;i++)
+		Proxies[i] = Tree.CreateProxy(boxes[i], i);
+
+	// Move some of the proxies, some of them out of their fat boxes
+	for(udword i=0;i<nb;i++)
+	{
+		if(rand() & 3)
+			continue;
+		const float Offset = float(rand() & 63) - 32.0f;
+		boxes[i].mMin.x += Offset;	boxes[i].mMax.x += Offset;
+		boxes[i].mMin.y -= Offset;	boxes[i].mMax.y -= Offset;
+		Tree.MoveProxy(Proxies[i], boxes[i]);
+	}
+
+	// The tree works on fat boxes, so that's what we compare against
+	AABB* FatBoxes = new AABB[nb+1];
+	for(udword i=0;i<nb;i++)
+		FatBoxes[i] = Tree.GetFatBox(Proxies[i]);
+
+	Container Ref;
+	BruteForcePairs(nb, FatBoxes, Ref);
+
+	Container Pairs;
+	Tree.FindPairs(Pairs);
+	CheckPairs("DynamicTree::FindPairs", test_index, Ref, Pairs);
+
+	DELETEARRAY(FatBoxes);
+	DELETEARRAY(Proxies);
+}
+
+static void TestMultiSAPBoxPruning(udword test_index, udword nb, const AABB* boxes, const Container& ref)
+{
+	Container Pairs;
+	MultiSAPBoxPruning(nb, boxes, Pairs, 1 + (rand() & 3), 1 + (rand() & 3));
+	CheckPairs("MultiSAPBoxPruning", test_index, ref, Pairs);
+}
+
+static void TestSlabBoxPruning(udword test_index, udword nb, const AABB* boxes, const Container& ref)
+{
+	// 0 is the automatic number of slabs
+	Container Pairs;
+	SlabBoxPruning(nb, boxes, Pairs, rand() & 7);
+	CheckPairs("SlabBoxPruning", test_index, ref, Pairs);
+}
+
+// Scalar version of the swept refinement: boxes move linearly over t=[0;1], returns true if they overlap at the same time
+static bool SweptOverlap(const AABB& start0, const AABB& end0, const AABB& start1, const AABB& end1)
+{
+	float TFirst = 0.0f;
+	float TLast = 1.0f;
+	for(udword Axis=0;Axis<3;Axis++)
+	{
+		const float C[2] = { start1.GetMax(Axis) - start0.GetMin(Axis), start0.GetMax(Axis) - start1.GetMin(Axis) };
+		const float D[2] = {
+			(end1.GetMax(Axis) - start1.GetMax(Axis)) - (end0.GetMin(Axis) - start0.GetMin(Axis)),
+			(end0.GetMax(Axis) - start0.GetMax(Axis)) - (end1.GetMin(Axis) - start1.GetMin(Axis)) };
+		for(udword j=0;j<2;j++)
+		{
+			const float T = (0.0f - C[j]) / D[j];
+			if(D[j]>0.0f)
+				TFirst = TMax(TFirst, T);
+			else if(D[j]<0.0f)
+				TLast = TMin(TLast, T);
+			else if(C[j]<0.0f)
+				return false;
+		}
+	}
+	return TFirst<=TLast;
+}
+
+static void TestSweptBoxPruning(udword test_index, udword nb, const AABB* boxes)
+{
+	AABB* End = new AABB[nb+1];
+	AABB* Swept = new AABB[nb+1];
+	for(udword i=0;i<nb;i++)
+	{
+		const Point Delta(float(rand() & 255) - 128.0f, float(rand() & 255) - 128.0f, float(rand() & 255) - 128.0f);
+		End[i].mMin = boxes[i].mMin + Delta;
+		End[i].mMax = boxes[i].mMax + Delta;
+		Swept[i].mMin.x = TMin(boxes[i].mMin.x, End[i].mMin.x);	Swept[i].mMax.x = TMax(boxes[i].mMax.x, End[i].mMax.x);
+		Swept[i].mMin.y = TMin(boxes[i].mMin.y, End[i].mMin.y);	Swept[i].mMax.y = TMax(boxes[i].mMax.y, End[i].mMax.y);
+		Swept[i].mMin.z = TMin(boxes[i].mMin.z, End[i].mMin.z);	Swept[i].mMax.z = TMax(boxes[i].mMax.z, End[i].mMax.z);
+	}
+
+	Container Ref;
+	BruteForcePairs(nb, Swept, Ref);
+
+	Container Pairs;
+	SweptBoxPruning(nb, boxes, End, Pairs, false);
+	CheckPairs("SweptBoxPruning", test_index, Ref, Pairs);
+
+	// Brute-force refinement of the conservative pairs
+	Container RefinedRef;
+	const Pair* Entries = (const Pair*)Ref.GetEntries();
+	const udword NbPairs = Ref.GetNbEntries()>>1;
+	for(udword i=0;i<NbPairs;i++)
+	{
+		const udword id0 = Entries[i].id0;
+		const udword id1 = Entries[i].id1;
+		if(SweptOverlap(boxes[id0], End[id0], boxes[id1], End[id1]))
+			RefinedRef.Add(id0).Add(id1);
+	}
+
+	Pairs.Reset();
+	SweptBoxPruning(nb, boxes, End, Pairs, true);
+	CheckPairs("SweptBoxPruning (refine)", test_index, RefinedRef, Pairs);
+
+	DELETEARRAY(Swept);
+	DELETEARRAY(End);
+}
+
+static void TestCompleteBoxPruningInflated(udword test_index, udword nb, const AABB* boxes)
+{
+	// Half-integer distances, so that the inflated bounds are exact and there are no ties
+	const float Distance = float(rand() & 31) + 0.5f;
+	const float HalfDistance = Distance*0.5f;
+	AABB* Inflated = new AABB[nb+1];
+	for(udword i=0;i<nb;i++)
+	{
+		Inflated[i].mMin = boxes[i].mMin - Point(HalfDistance, HalfDistance, HalfDistance);
+		Inflated[i].mMax = boxes[i].mMax + Point(HalfDistance, HalfDistance, HalfDistance);
+	}
+
+	Container Ref;
+	BruteForcePairs(nb, Inflated, Ref);
+
+	Container Pairs;
+	CompleteBoxPruningInflated(nb, boxes, Pairs, Distance);
+	CheckPairs("CompleteBoxPruningInflated", test_index, Ref, Pairs);
+
+	DELETEARRAY(Inflated);
+}
+
+static void TestPersistentBoxPruning(udword test_index, udword nb, const AABB* boxes)
+{
+	const udword NbFrames = 8;
+	const udword MaxNbObjects = nb + NbFrames*4;
+
+	PersistentBoxPruning PBP;
+	PBP.SetMargin(float(rand() & 15));
+
+	// Live handles, and current tight boxes indexed by handle
+	udword* Handles = new udword[MaxNbObjects+1];
+	AABB* Tight = new AABB[MaxNbObjects+1];
+	AABB* Fat = new AABB[MaxNbObjects+1];
+	udword NbObjects = 0;
+	for(udword i=0;i<nb;i++)
+	{
+		const udword Handle = PBP.AddObject(boxes[i]);
+		Tight[Handle] = boxes[i];
+		Handles[NbObjects++] = Handle;
+	}
+
+	Container Created, Deleted;
+	Container ExpectedCreated, ExpectedDeleted;
+	Container Ref, PrevRef, Tmp;
+	for(udword Frame=0;Frame<NbFrames;Frame++)
+	{
+		if(Frame)
+		{
+			// Mostly small motions, so that the incremental path is used, plus a few removals and additions
+			for(udword i=0;i<NbObjects;i++)
+			{
+				if(rand() & 7)
+					continue;
+				const udword Handle = Handles[i];
+				const float Offset = (rand() & 1) ? float(rand() & 3) : float(rand() & 127) - 64.0f;
+				Tight[Handle].mMin.x += Offset;	Tight[Handle].mMax.x += Offset;
+				Tight[Handle].mMin.z -= Offset;	Tight[Handle].mMax.z -= Offset;
+				PBP.UpdateObject(Handle, Tight[Handle]);
+			}
+			for(udword i=0;i<2 && NbObjects;i++)
+			{
+				const udword Index = rand() % NbObjects;
+				PBP.RemoveObject(Handles[Index]);
+				Handles[Index] = Handles[--NbObjects];
+			}
+			for(udword i=0;i<3;i++)
+			{
+				AABB Box;
+				GenerateRandomBoxes(1, &Box, 64, 1023);
+				const udword Handle = PBP.AddObject(Box);
+				Tight[Handle] = Box;
+				Handles[NbObjects++] = Handle;
+			}
+		}
+
+		Created.Reset();
+		Deleted.Reset();
+		PBP.Update(Created, Deleted);
+
+		// Pairs are reported for the fat boxes, as handles
+		for(udword i=0;i<NbObjects;i++)
+			Fat[i] = PBP.GetFatBox(Handles[i]);
+		Tmp.Reset();
+		BruteForcePairs(NbObjects, Fat, Tmp);
+		const udword NbPairs = Tmp.GetNbEntries();
+		udword* Entries = Tmp.GetEntries();
+		for(udword i=0;i<NbPairs;i++)
+			Entries[i] = Handles[Entries[i]];
+		SortPairs(Tmp, Ref);
+
+		CheckPairs("PersistentBoxPruning::GetPairs", test_index, Ref, PBP.GetPairs());
+
+		ExpectedCreated.Reset();
+		ExpectedDeleted.Reset();
+		DiffSortedPairs(Ref, PrevRef, ExpectedCreated, ExpectedDeleted);
+		CheckPairs("PersistentBoxPruning::Update (created)", test_index, ExpectedCreated, Created);
+		CheckPairs("PersistentBoxPruning::Update (deleted)", test_index, ExpectedDeleted, Deleted);
+
+		PrevRef.Reset();
+		if(Ref.GetNbEntries())
+			PrevRef.Add(Ref.GetEntries(), Ref.GetNbEntries());
+	}
+
+	DELETEARRAY(Fat);
+	DELETEARRAY(Tight);
+	DELETEARRAY(Handles);
+}
+
+static void TestKPartiteBoxPruning(udword test_index, udword nb, const AABB* boxes, const Container& ref)
+{
+	const udword NbSets = 1 + (rand() & 3);
+	udword* SetIds = new udword[nb+1];
+	for(udword i=0;i<nb;i++)
+		SetIds[i] = rand() % NbSets;
+
+	// Same pairs as the complete version, minus the ones within a set
+	Container Ref;
+	const Pair* Entries = (const Pair*)ref.GetEntries();
+	const udword NbPairs = ref.GetNbEntries()>>1;
+	for(udword i=0;i<NbPairs;i++)
+	{
+		if(SetIds[Entries[i].id0]!=SetIds[Entries[i].id1])
+			Ref.Add(Entries[i].id0).Add(Entries[i].id1);
+	}
+
+	Container Pairs;
+	KPartiteBoxPruning(nb, boxes, SetIds, Pairs);
+	CheckPairs("KPartiteBoxPruning", test_index, Ref, Pairs);
+
+	DELETEARRAY(SetIds);
+}
+
+static bool AccumulatePairs(const udword* pairs, udword nb_pairs, void* user_data)
+{
+	Container* Pages = (Container*)user_data;
+	// Number of pairs of each page first, then the pairs
+	Pages[0].Add(nb_pairs);
+	Pages[1].Add((udword*)pairs, nb_pairs*2);
+	return true;
+}
+
+static void TestCompleteBoxPruningStreamed(udword test_index, udword nb, const AABB* boxes, const Container& ref)
+{
+	const udword PageSize = 1 + (rand() & 7);
+	Container Pages[2];
+	CompleteBoxPruningStreamed(nb, boxes, AccumulatePairs, Pages, PageSize);
+	CheckPairs("CompleteBoxPruningStreamed", test_index, ref, Pages[1]);
+
+	// All pages but the last one are full
+	const udword NbPages = Pages[0].GetNbEntries();
+	for(udword i=0;i<NbPages;i++)
+	{
+		const udword NbPairs = Pages[0].GetEntry(i);
+		if(!NbPairs || NbPairs>PageSize || (i!=NbPages-1 && NbPairs!=PageSize))
+		{
+			printf("\n\nERROR: CompleteBoxPruningStreamed page size, test index: %d\n", test_index);
+			exit(0);
+		}
+	}
+}
+
+static void TestResumableBoxPruning(udword test_index, udword nb, const AABB* boxes, const Container& ref)
+{
+	// A tiny buffer, and for one test out of two a tiny budget as well, so that we resume from both kinds of interruptions
+	const udword MaxNbPairs = 4 + (rand() & 3);
+	udword Buffer[16];
+
+	ResumableBoxPruning RBP;
+	RBP.Init(nb, boxes);
+	RBP.SetBudget((test_index & 1) ? 2000 : 0);
+
+	Container Pairs;
+	ResumeStatus Status;
+	do
+	{
+		udword NbPairs = 0;
+		Status = RBP.Run(Buffer, MaxNbPairs, NbPairs);
+		if(Status!=RESUME_DONE && Status!=RESUME_BUFFER_FULL && Status!=RESUME_OUT_OF_BUDGET)
+		{
+			printf("\n\nERROR: ResumableBoxPruning status %d, test index: %d\n", Status, test_index);
+			exit(0);
+		}
+		Pairs.Add(Buffer, NbPairs*2);
+	}while(Status!=RESUME_DONE);
+
+	CheckPairs("ResumableBoxPruning", test_index, ref, Pairs);
+}
+
+static void TestSubmitCompleteBoxPruning(udword test_index, udword nb, const AABB* boxes, const Container& ref)
+{
+	BoxPruningTask Task;
+	SubmitCompleteBoxPruning(nb, boxes, Task);
+	CheckPairs("SubmitCompleteBoxPruning", test_index, ref, Task.Wait());
+}
+
+struct PipelineValidity
+{
+	const udword*		mNbBoxes;
+	const AABB* const*	mSnapshots;
+	udword				mNbCalls;
+	bool				mFailed;
+};
+
+static void CheckSnapshotPairs(udword snapshot_index, const Container& pairs, void* user_data)
+{
+	PipelineValidity* PV = (PipelineValidity*)user_data;
+
+	Container Ref;
+	BruteForcePairs(PV->mNbBoxes[snapshot_index], PV->mSnapshots[snapshot_index], Ref);
+
+	// Snapshots are reported in order
+	if(snapshot_index!=PV->mNbCalls++ || !SamePairs(Ref, pairs))
+		PV->mFailed = true;
+}
+
+static void TestPipelinedBoxPruning(udword test_index, udword nb, const AABB* boxes)
+{
+	// The first snapshot is the test's boxes, the next ones are random
+	const udword NbSnapshots = 1 + (rand() & 3);
+	udword NbBoxes[4];
+	const AABB* Snapshots[4];
+	NbBoxes[0] = nb;
+	Snapshots[0] = boxes;
+	for(udword i=1;i<NbSnapshots;i++)
+	{
+		NbBoxes[i] = rand() & 511;
+		AABB* Boxes = new AABB[NbBoxes[i]+1];
+		GenerateRandomBoxes(NbBoxes[i], Boxes, 1 + (rand() & 127), 1023);
+		Snapshots[i] = Boxes;
+	}
+
+	PipelineValidity PV;
+	PV.mNbBoxes = NbBoxes;
+	PV.mSnapshots = Snapshots;
+	PV.mNbCalls = 0;
+	PV.mFailed = false;
+	PipelinedBoxPruning(NbSnapshots, NbBoxes, Snapshots, CheckSnapshotPairs, &PV);
+	if(PV.mFailed || PV.mNbCalls!=NbSnapshots)
+	{
+		printf("\n\nERROR: PipelinedBoxPruning, test index: %d\n", test_index);
+		exit(0);
+	}
+
+	for(udword i=1;i<NbSnapshots;i++)
+		DELETEARRAY(Snapshots[i]);
+}
+
+static void TestBatchedBoxPruning(udword test_index)
+{
+	const udword NbScenes = 1 + (rand() & 15);
+	udword SceneOffsets[17];
+	udword PairOffsets[17];
+	SceneOffsets[0] = 0;
+	for(udword i=0;i<NbScenes;i++)
+		SceneOffsets[i+1] = SceneOffsets[i] + ((rand() & 3) ? rand() & 127 : 0);
+
+	const udword NbBoxes = SceneOffsets[NbScenes];
+	AABB* Boxes = new AABB[NbBoxes+1];
+	GenerateRandomBoxes(NbBoxes, Boxes, 1 + (rand() & 127), 511);
+
+	Container Pairs;
+	BatchedBoxPruning(NbScenes, SceneOffsets, Boxes, Pairs, PairOffsets);
+	if(PairOffsets[NbScenes]*2!=Pairs.GetNbEntries())
+	{
+		printf("\n\nERROR: BatchedBoxPruning pair offsets, test index: %d\n", test_index);
+		exit(0);
+	}
+
+	// Each scene against its own brute-force pairs, in whole-list indices
+	Container Ref, ScenePairs;
+	for(udword i=0;i<NbScenes;i++)
+	{
+		Ref.Reset();
+		BruteForcePairs(SceneOffsets[i+1] - SceneOffsets[i], Boxes + SceneOffsets[i], Ref);
+		const udword NbEntries = Ref.GetNbEntries();
+		udword* Entries = Ref.GetEntries();
+		for(udword j=0;j<NbEntries;j++)
+			Entries[j] += SceneOffsets[i];
+
+		ScenePairs.Reset();
+		if(PairOffsets[i+1]!=PairOffsets[i])
+			ScenePairs.Add(Pairs.GetEntries() + PairOffsets[i]*2, (PairOffsets[i+1] - PairOffsets[i])*2);
+		CheckPairs("BatchedBoxPruning", test_index, Ref, ScenePairs);
+	}
+
+	DELETEARRAY(Boxes);
+}
+
+static udword RandomSetSize()
+{
+	// Empty sets and single boxes are special cases worth hitting often
+	switch(rand() & 3)
+	{
+		case 0:		return 0;
+		case 1:		return 1;
+		default:	return rand() & 511;
+	}
+}
+
+static void TestBipartiteBoxPruning(udword test_index)
+{
+	const udword NbBoxes0 = RandomSetSize();
+	const udword NbBoxes1 = RandomSetSize();
+	const udword BoxSize = 1 + (rand() & 255);
+	const udword Range = rand() & 2047;
+	AABB* Boxes0 = new AABB[NbBoxes0+1];
+	AABB* Boxes1 = new AABB[NbBoxes1+1];
+	GenerateRandomBoxes(NbBoxes0, Boxes0, BoxSize, Range);
+	GenerateRandomBoxes(NbBoxes1, Boxes1, BoxSize, Range);
+
+	// MinX ties across the sets, and touching boxes along X
+	if(NbBoxes0)
+	{
+		for(udword i=0;i<NbBoxes1;i++)
+		{
+			const AABB& Box0 = Boxes0[rand() % NbBoxes0];
+			switch(rand() & 3)
+			{
+				case 0:	Boxes1[i].mMin.x = Box0.mMin.x;	break;
+				case 1:	Boxes1[i].mMin.x = Box0.mMax.x;	break;
+			}
+			Boxes1[i].mMax.x = TMax(Boxes1[i].mMax.x, Boxes1[i].mMin.x);
+		}
+	}
+
+	const AABB** List0 = new const AABB*[NbBoxes0+1];
+	const AABB** List1 = new const AABB*[NbBoxes1+1];
+	for(udword i=0;i<NbBoxes0;i++)
+		List0[i] = &Boxes0[i];
+	for(udword i=0;i<NbBoxes1;i++)
+		List1[i] = &Boxes1[i];
+
+	Container Ref;
+	BruteForceBipartiteBoxTest(NbBoxes0, List0, NbBoxes1, List1, Ref);
+
+	Container Pairs;
+	const bool Status = BipartiteBoxPruning(NbBoxes0, Boxes0, NbBoxes1, Boxes1, Pairs);
+	if(Status!=(NbBoxes0 && NbBoxes1))
+	{
+		printf("\n\nERROR: BipartiteBoxPruning return value, test index: %d\n", test_index);
+		exit(0);
+	}
+
+	// Pairs are (index in list0, index in list1). Offsetting the second index keeps that order through the comparison.
+	udword* Entries = Ref.GetEntries();
+	for(udword i=1;i<Ref.GetNbEntries();i+=2)
+		Entries[i] += NbBoxes0;
+	Entries = Pairs.GetEntries();
+	for(udword i=1;i<Pairs.GetNbEntries();i+=2)
+		Entries[i] += NbBoxes0;
+	CheckPairs("BipartiteBoxPruning", test_index, Ref, Pairs);
+
+	DELETEARRAY(List1);
+	DELETEARRAY(List0);
+	DELETEARRAY(Boxes1);
+	DELETEARRAY(Boxes0);
+}
+
+void RunExtendedValidityTests()
+{
+	srand(42);
+
+	Container Ref;
+
+	const udword NbTests = 200;
+	for(udword TestIndex=0;TestIndex<NbTests;TestIndex++)
+	{
+		printf(".");
+
+		// Second half with the helper pool, for the parallel builds and the pipelining
+		if(TestIndex==NbTests/2)
+			ConfigureBoxPruningThreadPool(0, false, null, null, true);
+
+		const udword NbBoxes = rand() & 1023;
+		const udword BoxSize = 1 + (rand() & 255);
+		const udword Range = rand() & 4095;
+		AABB* Boxes = new AABB[NbBoxes+1];
+		GenerateRandomBoxes(NbBoxes, Boxes, BoxSize, Range);
+
+		Ref.Reset();
+		BruteForcePairs(NbBoxes, Boxes, Ref);
+
+		TestGridBoxPruning(TestIndex, NbBoxes, Boxes, Ref);
+		TestMultiSAPBoxPruning(TestIndex, NbBoxes, Boxes, Ref);
+		TestSlabBoxPruning(TestIndex, NbBoxes, Boxes, Ref);
+		TestKPartiteBoxPruning(TestIndex, NbBoxes, Boxes, Ref);
+		TestCompleteBoxPruningStreamed(TestIndex, NbBoxes, Boxes, Ref);
+		TestResumableBoxPruning(TestIndex, NbBoxes, Boxes, Ref);
+		TestSubmitCompleteBoxPruning(TestIndex, NbBoxes, Boxes, Ref);
+		TestSweptBoxPruning(TestIndex, NbBoxes, Boxes);
+		TestCompleteBoxPruningInflated(TestIndex, NbBoxes, Boxes);
+		TestPipelinedBoxPruning(TestIndex, NbBoxes, Boxes);
+		TestPersistentBoxPruning(TestIndex, NbBoxes, Boxes);
+		TestBatchedBoxPruning(TestIndex);
+		TestBipartiteBoxPruning(TestIndex);
+		// Last, it moves the boxes
+		TestDynamicTree(TestIndex, NbBoxes, Boxes);
+
+		DELETEARRAY(Boxes);
+	}
+	ConfigureBoxPruningThreadPool(0, false, null, null, false);
+	printf("\nFinished extended tests.\n");
+}
+#endif
+
+#ifdef USE_COHERENT_SORT_TEST
+// Sorts the boxes along X over a sequence of frames where they move a little, with both sorters. This is the case AdaptiveSort is
+// meant for, see PRUNING_SORTER. Called from Main.cpp.
+
+static bool IsSortedAlongX(udword nb, const AABB* boxes, const udword* ranks)
+{
+	for(udword i=1;i<nb;i++)
+	{
+		if(boxes[ranks[i]].mMin.x < boxes[ranks[i-1]].mMin.x)
+			return false;
+	}
+	return true;
+}
+
+void RunCoherentSortTest()
+{
+	const udword NbBoxes = 10000;
+	const udword NbFrames = 256;
+
+	// Same boxes as the performance test, with small velocities along X
+	AABB* Boxes = new AABB[NbBoxes];
+	float* Velocities = new float[NbBoxes];
+	srand(42);
+	for(udword i=0;i<NbBoxes;i++)
+	{
+		const float x = float(rand() & 4095) - 2048.0f;
+		const float y = float(rand() & 4095) - 2048.0f;
+		const float z = float(rand() & 4095) - 2048.0f;
+		const float ex = float(rand() & 127);
+		const float ey = float(rand() & 127);
+		const float ez = float(rand() & 127);
+		Boxes[i].mMin.x = x - ex;
+		Boxes[i].mMin.y = y - ey;
+		Boxes[i].mMin.z = z - ez;
+		Boxes[i].mMax.x = x + ex;
+		Boxes[i].mMax.y = y + ey;
+		Boxes[i].mMax.z = z + ez;
+		Velocities[i] = float((rand() & 63) - 32) / 1024.0f;
+	}
+
+	// Same settings as the pruning functions
+	AdaptiveSort AS;
+	RadixSort RS;
+	AS.SetMode(RADIX_AUTO);
+	RS.SetMode(RADIX_AUTO);
+
+	udword AdaptiveTime = 0;
+	udword RadixTime = 0;
+	udword Time;
+	for(udword Frame=0;Frame<NbFrames;Frame++)
+	{
+		for(udword i=0;i<NbBoxes;i++)
+		{
+			Boxes[i].mMin.x += Velocities[i];
+			Boxes[i].mMax.x += Velocities[i];
+		}
+
+		StartProfile(Time);
+			const udword* AdaptiveRanks = AS.Sort(&Boxes[0].mMin.x, NbBoxes, sizeof(AABB)).GetRanks();
+		EndProfile(Time);
+		AdaptiveTime += Time;
+
+		StartProfile(Time);
+			const udword* RadixRanks = RS.Sort(&Boxes[0].mMin.x, NbBoxes, sizeof(AABB)).GetRanks();
+		EndProfile(Time);
+		RadixTime += Time;
+
+		if(!IsSortedAlongX(NbBoxes, Boxes, AdaptiveRanks) || !IsSortedAlongX(NbBoxes, Boxes, RadixRanks))
+		{
+			printf("ERROR: coherent sort test, frame: %d\n", Frame);
+			exit(0);
+		}
+	}
+	printf("Coherent sort test (radix sort): %d frames in %d K-cycles.\n", NbFrames, RadixTime/1024);
+	printf("Coherent sort test (adaptive sort): %d frames in %d K-cycles.\n", NbFrames, AdaptiveTime/1024);
+
+	DELETEARRAY(Velocities);
+	DELETEARRAY(Boxes);
+}
+#endif
+
 #ifdef REMOVED
 
 void RunTest();
@@ -0,0 +1,210 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+ *	Contains code for the "box pruning revisited" project.
+ *	\file		IceBoxFile.cpp
+ *	\author		Pierre Terdiman
+ *	\date		February 2017
+ */
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Precompiled Header
+#include "Stdafx.h"
+
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+
+using namespace Meshmerizer;
+
+// Boxes are converted to SoA in chunks of this size when writing
+static const udword kWriteChunkSize = 4096;
+
+static bool WriteZeros(FILE* fp, udword nb_bytes)
+{
+	static const ubyte Zeros[16] = {0};
+	return !nb_bytes || fwrite(Zeros, nb_bytes, 1, fp)==1;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+ *	Saves a list of boxes to a binary box file.
+ *	\param		filename	[in] file name
+ *	\param		nb			[in] number of boxes
+ *	\param		list		[in] list of boxes
+ *	\param		layout		[in] payload layout
+ *	\return		true if success.
+ */
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+bool Meshmerizer::SaveBoxFile(const char* filename, udword nb, const AABB* list, BoxFileLayout layout)
+{
+	// Checkings
+	if(!filename || (nb && !list))
+		return false;
+
+	BoxFileHeader Header;
+	ZeroMemory(&Header, sizeof(BoxFileHeader));
+	Header.mMagic			= BOX_FILE_MAGIC;
+	Header.mVersion			= BOX_FILE_VERSION;
+	Header.mLayout			= layout;
+	Header.mNbBoxes			= nb;
+	Header.mPayloadOffset	= sizeof(BoxFileHeader);
+	if(nb)
+	{
+		Header.mBounds = list[0];
+		for(udword i=1;i<nb;i++)
+		{
+			Header.mBounds.mMin.Min(list[i].mMin);
+			Header.mBounds.mMax.Max(list[i].mMax);
+		}
+	}
+
+	FILE* fp = null;
+	if(fopen_s(&fp, filename, "wb"))
+		return false;
+
+	bool Status = fwrite(&Header, sizeof(BoxFileHeader), 1, fp)==1;
+	if(layout==BOX_FILE_AOS)
+	{
+		Status &= !nb || fwrite(list, sizeof(AABB)*nb, 1, fp)==1;
+	}
+	else
+	{
+		// One array after the other, each padded to 16 bytes
+		float* Chunk = new float[kWriteChunkSize];
+		const udword Padding = (GetBoxFileArrayStride(nb) - nb)*sizeof(float);
+		for(udword j=0;j<6 && Status;j++)
+		{
+			for(udword Base=0;Base<nb && Status;Base+=kWriteChunkSize)
+			{
+				const udword NbInChunk = TMin(kWriteChunkSize, nb-Base);
+				for(udword i=0;i<NbInChunk;i++)
+				{
+					const AABB& Box = list[Base+i];
+					Chunk[i] = j<3 ? Box.GetMin(j) : Box.GetMax(j-3);
+				}
+				Status &= fwrite(Chunk, NbInChunk*sizeof(float), 1, fp)==1;
+			}
+			Status &= WriteZeros(fp, Padding);
+		}
+		DELETEARRAY(Chunk);
+	}
+
+	Status &= fclose(fp)==0;
+	return Status;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+ *	Constructor.
+ */
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+BoxFile::BoxFile() : mFile(INVALID_HANDLE_VALUE), mMapping(null), mHeader(null), mPayload(null)
+{
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+ *	Destructor.
+ */
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+BoxFile::~BoxFile()
+{
+	Close();
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+ *	Opens and maps a box file. The header and file size are validated, the payload isn't touched.
+ *	\param		filename	[in] file name
+ *	\return		true if success.
+ */
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+bool BoxFile::Open(const char* filename)
+{
+	Close();
+	if(!filename)
+		return false;
+
+	mFile = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, null, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL|FILE_FLAG_SEQUENTIAL_SCAN, null);
+	if(mFile==INVALID_HANDLE_VALUE)
+		return false;
+
+	// The whole file is mapped, so it has to fit in the address space. In 32-bit builds that's about 2 GB at best, and MapViewOfFile
+	// below fails for smaller files too when the address space is fragmented. Such files are for OutOfCoreBoxPruning.
+	LARGE_INTEGER FileSize;
+	if(!GetFileSizeEx(mFile, &FileSize) || uqword(FileSize.QuadPart)<sizeof(BoxFileHeader) || uqword(FileSize.QuadPart)>uqword(size_t(-1)))
+	{
+		Close();
+		return false;
+	}
+
+	mMapping = CreateFileMappingA(mFile, null, PAGE_READONLY, 0, 0, null);
+	if(mMapping)
+		mHeader = (const BoxFileHeader*)MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0);
+	if(!mHeader)
+	{
+		Close();
+		return false;
+	}
+
+	// Validate the header, and make sure the payload is all there. The payload must be 16-byte aligned for the SoA arrays to be.
+	const udword nb = mHeader->mNbBoxes;
+	const uqword PayloadSize = mHeader->mLayout==BOX_FILE_AOS ? uqword(nb)*sizeof(AABB) : uqword(GetBoxFileArrayStride(nb))*6*sizeof(float);
+	if(		mHeader->mMagic!=BOX_FILE_MAGIC
+		||	mHeader->mVersion!=BOX_FILE_VERSION
+		||	(mHeader->mLayout!=BOX_FILE_AOS && mHeader->mLayout!=BOX_FILE_SOA)
+		||	mHeader->mPayloadOffset<sizeof(BoxFileHeader)
+		||	(mHeader->mPayloadOffset & 15)
+		||	mHeader->mPayloadOffset + PayloadSize > uqword(FileSize.QuadPart))
+	{
+		Close();
+		return false;
+	}
+
+	mPayload = (const ubyte*)mHeader + mHeader->mPayloadOffset;
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+ *	Unmaps and closes the file.
+ */
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+void BoxFile::Close()
+{
+	if(mHeader)
+	{
+		UnmapViewOfFile(mHeader);
+		mHeader = null;
+		mPayload = null;
+	}
+	if(mMapping)
+	{
+		CloseHandle(mMapping);
+		mMapping = null;
+	}
+	if(mFile!=INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(mFile);
+		mFile = INVALID_HANDLE_VALUE;
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+ *	Runs complete box pruning directly on the mapped boxes, using the SoA-input version for SoA files.
+ *	\param		pairs	[out] list of overlapping pairs
+ *	\return		true if success.
+ */
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+bool BoxFile::Prune(Container& pairs) const
+{
+	if(!mHeader)
+		return false;
+
+	if(GetLayout()==BOX_FILE_AOS)
+		return CompleteBoxPruning(GetNbBoxes(), GetBoxes(), pairs);
+
+	return CompleteBoxPruningSoA(GetNbBoxes(), GetArray(0), GetArray(1), GetArray(2), GetArray(3), GetArray(4), GetArray(5), pairs);
+}
@@ -0,0 +1,76 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+ *	Contains code for the "box pruning revisited" project.
+ *	\file		IceBoxFile.h
+ *	\author		Pierre Terdiman
+ *	\date		February 2017
+ */
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Include Guard
+#ifndef ICEBOXFILE_H
+#define ICEBOXFILE_H
+
+	#define BOX_FILE_MAGIC		0x46584f42	// "BOXF"
+	#define BOX_FILE_VERSION	1
+
+	enum BoxFileLayout
+	{
+		BOX_FILE_AOS		= 0,	//!< Payload is an array of AABBs
+		BOX_FILE_SOA		= 1,	//!< Payload is 6 arrays of floats: MinX, MinY, MinZ, MaxX, MaxY, MaxZ
+	};
+
+	// Binary box file header. The payload starts at mPayloadOffset, which must be a multiple of 16. For SoA files each array is padded
+	// to a multiple of 16 bytes (i.e. arrays are GetBoxFileArrayStride(nb) floats apart), so that arrays are 16-byte aligned when the
+	// file is mapped. Payloads are always floats: there is no integer payload, the bounds are converted to sortable integers when the
+	// pruning code builds its own SoA copy, so storing them pre-converted wouldn't save anything.
+	struct MESHMERIZER_API BoxFileHeader
+	{
+		udword			mMagic;			//!< BOX_FILE_MAGIC
+		udword			mVersion;		//!< BOX_FILE_VERSION
+		udword			mLayout;		//!< BoxFileLayout
+		udword			mNbBoxes;
+		AABB			mBounds;		//!< Bounds of all the boxes
+		udword			mPayloadOffset;	//!< Offset of the payload from the start of the file, in bytes
+		udword			mPad[5];
+	};
+
+	inline_ udword	GetBoxFileArrayStride(udword nb)	{ return (nb+3)&~3;	}
+
+	// Box file writer
+	FUNCTION MESHMERIZER_API bool SaveBoxFile(const char* filename, udword nb, const AABB* list, BoxFileLayout layout);
+
+	// Box file reader. The file is memory-mapped and the boxes are used in-place, without copy or parsing. The whole file is mapped
+	// at once, so it has to fit in the address space: in 32-bit builds Open fails for files larger than about 2 GB. Larger datasets
+	// must go through OutOfCoreBoxPruning, which streams the file instead.
+	class MESHMERIZER_API BoxFile
+	{
+		public:
+		// Constructor/Destructor
+								BoxFile();
+								~BoxFile();
+
+				bool			Open(const char* filename);
+				void			Close();
+
+				bool			Prune(Container& pairs)	const;
+
+		inline_	bool			IsOpen()				const	{ return mHeader!=null;								}
+		inline_	udword			GetNbBoxes()			const	{ return mHeader->mNbBoxes;							}
+		inline_	const AABB&		GetBounds()				const	{ return mHeader->mBounds;							}
+		inline_	BoxFileLayout	GetLayout()				const	{ return BoxFileLayout(mHeader->mLayout);			}
+		//! Returns the boxes of an AoS file, null for SoA files
+		inline_	const AABB*		GetBoxes()				const	{ return mHeader->mLayout==BOX_FILE_AOS ? (const AABB*)mPayload : null;	}
+		//! Returns one of the 6 arrays of an SoA file (0-2: min x,y,z, 3-5: max x,y,z), null for AoS files
+		inline_	const float*	GetArray(udword i)		const	{ return mHeader->mLayout==BOX_FILE_SOA ? (const float*)mPayload + i*GetBoxFileArrayStride(mHeader->mNbBoxes) : null;	}
+
+								PREVENT_COPY(BoxFile)
+		private:
+				void*			mFile;			//!< File handle
+				void*			mMapping;		//!< File mapping handle
+				const BoxFileHeader*	mHeader;	//!< Start of the mapped view
+				const ubyte*	mPayload;
+	};
+
+#endif // ICEBOXFILE_H
@@ -10,128 +10,13 @@
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Precompiled Header
 #include "Stdafx.h"
+#include "IcePairOutputBuffer.h"
 
-using namespace Meshmerizer;
-
-// InsertionSort has better coherence, RadixSort is better for one-shot queries.
-#define PRUNING_SORTER	RadixSort
-//#define PRUNING_SORTER	InsertionSort
-
-static __forceinline int intersects2D(const AABB& a, const AABB& b)
-{
-       if(    b.mMax.y < a.mMin.y || a.mMax.y < b.mMin.y
-       ||     b.mMax.z < a.mMin.z || a.mMax.z < b.mMin.z)
-              return 0;
-       return 1;
-}
-
-///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-/**
- *	Bipartite box pruning. Returns a list of overlapping pairs of boxes, each box of the pair belongs to a different set.
- *	\param		nb0		[in] number of boxes in the first set
- *	\param		list0	[in] list of boxes for the first set
- *	\param		nb1		[in] number of boxes in the second set
- *	\param		list1	[in] list of boxes for the second set
- *	\param		pairs	[out] list of overlapping pairs
- *	\param		axes	[in] projection order (0,2,1 is often best)
- *	\return		true if success.
- */
-///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-bool Meshmerizer::BipartiteBoxPruning(udword nb0, const AABB* list0, udword nb1, const AABB* list1, Container& pairs)
-{
-	// Checkings
-	if(!nb0 || !list0 || !nb1 || !list1)
-		return false;
-
-	AABB* BoxList0 = new AABB[nb0+1];
-	AABB* BoxList1 = new AABB[nb1+1];
-	udword* Remap0;
-	udword* Remap1;
-	{
-		// Allocate some temporary data
-		float* PosList0 = new float[nb0+1];
-		float* PosList1 = new float[nb1+1];
-
-		// 1) Build main lists using the primary axis
-		for(udword i=0;i<nb0;i++)
-			PosList0[i] = list0[i].mMin.x;
-		PosList0[nb0] = FLT_MAX;
-		for(udword i=0;i<nb1;i++)
-			PosList1[i] = list1[i].mMin.x;
-		PosList1[nb1] = FLT_MAX;
-
-		// 2) Sort the lists
-		static PRUNING_SORTER RS0, RS1;	// Static for coherence.
-		Remap0 = RS0.Sort(PosList0, nb0+1).GetRanks();
-		Remap1 = RS1.Sort(PosList1, nb1+1).GetRanks();
-
-		for(udword i=0;i<nb0;i++)
-			BoxList0[i] = list0[Remap0[i]];
-		BoxList0[nb0].mMin.x = FLT_MAX;
-
-		for(udword i=0;i<nb1;i++)
-			BoxList1[i] = list1[Remap1[i]];
-		BoxList1[nb1].mMin.x = FLT_MAX;
-
-		DELETEARRAY(PosList1);
-		DELETEARRAY(PosList0);
-	}
-
-	// 3) Prune the lists
-	udword Index0 = 0;
-	udword RunningAddress1 = 0;
-	while(RunningAddress1<nb1 && Index0<nb0)
-	{
-		const AABB& Box0 = BoxList0[Index0];
-
-		const float MinLimit = Box0.mMin.x;
-		while(BoxList1[RunningAddress1].mMin.x<MinLimit)
-			RunningAddress1++;
-
-		const udword RIndex0 = Remap0[Index0];
-		udword Index1 = RunningAddress1;
-		const float MaxLimit = Box0.mMax.x;
-		while(BoxList1[Index1].mMin.x<=MaxLimit)
-		{
-			if(intersects2D(Box0, BoxList1[Index1]))
-				pairs.Add(RIndex0).Add(Remap1[Index1]);
-
-			Index1++;
-		}
-		Index0++;
-	}
-
-	////
-
-	Index0 = 0;
-	udword RunningAddress0 = 0;
-	while(RunningAddress0<nb0 && Index0<nb1)
-	{
-		const AABB& Box1 = BoxList1[Index0];
-
-		const float MinLimit = Box1.mMin.x;
-		while(BoxList0[RunningAddress0].mMin.x<=MinLimit)
-			RunningAddress0++;
-
-		const udword RIndex1 = Remap1[Index0];
-		udword Index1 = RunningAddress0;
-		const float MaxLimit = Box1.mMax.x;
-		while(BoxList0[Index1].mMin.x<=MaxLimit)
-		{
-			if(intersects2D(BoxList0[Index1], Box1))
-				pairs.Add(Remap0[Index1]).Add(RIndex1);
-
-			Index1++;
-		}
-		Index0++;
-	}
-
-	DELETEARRAY(BoxList1);
-	DELETEARRAY(BoxList0);
-
-	return true;
-}
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
 
+using namespace Meshmerizer;
 
 // Munge the float bits to return produce an unsigned order-preserving
 // ranking of floating-point numbers.
@@ -169,66 +54,6 @@ static inline __m128i MungeFloatSSE(__m128 f)
 	return _mm_xor_si128(_mm_castps_si128(f), toggle);
 }
 
-// Pair output buffer. We use this instead of a Container because we want slightly different
-// insertion semantics. No real abstraction in here; seeing as the whole point of this is to
-// (eventually) poke around in these fields from ASM code, it seems pointless.
-//
-// While the PairOutputBuffer is active, it takes over management of the storage for the
-// underlying Container. On destruction, it returns the storage back to the container.
-struct PairOutputBuffer
-{
-	static const size_t kSlack = 16; // distance from the high watermark to the actual capacity
-
-	udword*	mEnd;			// Pointer to current end (just past last inserted element)
-	udword* mHighWatermark;	// Pointer to kSlack elements before the end of the allocated storage
-	udword* mBegin;			// Pointer to beginning of storage
-	Container &mHost;		// The container we're outputting to.
-
-	PairOutputBuffer(Container &host);
-	~PairOutputBuffer();
-};
-
-PairOutputBuffer::PairOutputBuffer(Container &host)
-	: mHost(host)
-{
-	if (mHost.GetCapacity() < kSlack)
-		mHost.Resize(kSlack);
-
-	mBegin = host.GetEntries();
-	mEnd = mBegin + host.GetNbEntries();
-	mHighWatermark = mBegin + host.GetCapacity() - kSlack;
-}
-
-PairOutputBuffer::~PairOutputBuffer()
-{
-	// Return storage back to the container.
-	mHost.mEntries = mBegin;
-	mHost.mCurNbEntries = mEnd - mBegin;
-	mHost.mMaxNbEntries = (mHighWatermark + kSlack) - mBegin;
-}
-
-static void __stdcall GrowPairOutputBuffer(PairOutputBuffer &buf)
-{
-	size_t numEntries = buf.mEnd - buf.mBegin;
-	size_t newCapacity = numEntries * 2 + 2*PairOutputBuffer::kSlack;
-
-	udword* NewEntries = new udword[newCapacity];
-	CopyMemory(NewEntries, buf.mBegin, numEntries*sizeof(udword));
-	DELETEARRAY(buf.mBegin);
-
-	buf.mBegin = NewEntries;
-	buf.mEnd = buf.mBegin + numEntries;
-	buf.mHighWatermark = buf.mBegin + newCapacity - PairOutputBuffer::kSlack;
-}
-
-// Count trailing zeroes
-static inline udword Ctz32(udword x)
-{
-	unsigned long idx;
-	_BitScanForward(&idx, x);
-	return idx;
-}
-
 template<typename T>
 static inline T* PtrAddBytes(T* ptr, ptrdiff_t bytes)
 {
@@ -240,25 +65,6 @@ static void Error()
 	printf("ERROR!\n");
 }
 
-// Reports a bunch of intersections as specified by a base index and a bit mask.
-static void __stdcall ReportIntersections(PairOutputBuffer& POB, udword remap_id0, const udword* remap_base, udword mask)
-{
-	// Make sure there's enough space to insert our new elements
-	if (POB.mEnd > POB.mHighWatermark)
-		GrowPairOutputBuffer(POB);
-
-	udword *Pairs = POB.mEnd;
-
-	do
-	{
-		*Pairs++ = remap_id0;
-		*Pairs++ = remap_base[Ctz32(mask)];
-		mask &= mask - 1;
-	} while (mask);
-
-	POB.mEnd = Pairs;
-}
-
 // Reports up to 4 intersections using SSE2 (mask must be <=15!)
 static const __declspec(align(16)) sdword MoveMasksSSE2[16][8] = {
 	{  0, 0, 0, 0, 0, 0, 0, 0 }, // 0
@@ -288,12 +94,9 @@ static inline __m128i SelectSSE2(__m128i a, __m128i b, __m128i mask)
 	return _mm_or_si128(_mm_and_si128(a, mask), _mm_andnot_si128(mask, b));
 }
 
-static __forceinline void ReportUpTo4Intersections(PairOutputBuffer& POB, udword remap_id0, const udword *remap_base, udword mask)
+// Stores up to 4 intersections at the given address, returns the new end. Always writes 4 pairs worth of data.
+static __forceinline udword* StoreUpTo4Intersections(udword* Pairs, udword remap_id0, const udword *remap_base, udword mask)
 {
-	// Make sure there's enough space to insert our new elements
-	if (POB.mEnd > POB.mHighWatermark)
-		GrowPairOutputBuffer(POB);
-
 	__m128i VecRemappedId0 = _mm_set1_epi32(remap_id0);
 
 	// Grab 4 remapped Id1s. Now we need to compact this vector so it only contains
@@ -311,14 +114,44 @@ static __forceinline void ReportUpTo4Intersections(PairOutputBuffer& POB, udword
 	VecRemappedId1 = SelectSSE2(_mm_shuffle_epi32(VecRemappedId1, 0xfe), VecRemappedId1, MoveMask2);
 
 	// Interleave the compacted vector with VecRemappedId0 and store
-	udword *Pairs = POB.mEnd;
 	_mm_storeu_si128((__m128i *) (Pairs + 0), _mm_unpacklo_epi32(VecRemappedId0, VecRemappedId1));
 	_mm_storeu_si128((__m128i *) (Pairs + 4), _mm_unpackhi_epi32(VecRemappedId0, VecRemappedId1));
 
-	POB.mEnd = PtrAddBytes(Pairs, PopCount8[mask]);
+	return PtrAddBytes(Pairs, PopCount8[mask]);
 }
 
-static void BoxPruningKernelIntrinsics(PairOutputBuffer &POB, FloatOrInt32* BoxBase, FloatOrInt32* BoxEnd, udword* Remap, ptrdiff_t BoxBytesP)
+static __forceinline void ReportUpTo4Intersections(PairOutputBuffer& POB, udword remap_id0, const udword *remap_base, udword mask)
+{
+	// Make sure there's enough space to insert our new elements
+	if (POB.mEnd > POB.mHighWatermark)
+		GrowPairOutputBuffer(POB);
+
+	POB.mEnd = StoreUpTo4Intersections(POB.mEnd, remap_id0, remap_base, mask);
+}
+
+// Set id policies for BoxPruningKernelT. With NoSetFilter the kernel is the plain one, with SetFilter boxes also have a
+// set id, stored in a 7th array after MinZ, and pairs of boxes from the same set are rejected.
+struct NoSetFilter
+{
+	__forceinline	NoSetFilter(const FloatOrInt32*, ptrdiff_t)	{}
+	__forceinline	__m128	Apply(__m128 cmp, const FloatOrInt32*, ptrdiff_t)	const	{ return cmp;	}
+};
+
+struct SetFilter
+{
+	__forceinline	SetFilter(const FloatOrInt32* box0, ptrdiff_t box_bytes_p) : mBox0Set(_mm_set1_epi32(PtrAddBytes(box0, 3*box_bytes_p)->s))	{}
+
+	__forceinline	__m128	Apply(__m128 cmp, const FloatOrInt32* box1, ptrdiff_t box_bytes_p)	const
+	{
+		const __m128i Box1Set = _mm_loadu_si128((const __m128i *)&PtrAddBytes(box1, 3*box_bytes_p)->s);
+		return _mm_andnot_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(Box1Set, mBox0Set)), cmp);
+	}
+
+	__m128i	mBox0Set;
+};
+
+template<class SetFilterT>
+static __forceinline void BoxPruningKernelT(PairOutputBuffer &POB, FloatOrInt32* BoxBase, FloatOrInt32* BoxEnd, udword* Remap, ptrdiff_t BoxBytesP)
 {
 	ptrdiff_t BoxBytesN = -BoxBytesP;
 	FloatOrInt32 *Box0Ptr = BoxBase; // corresponds to Index0
@@ -338,6 +171,7 @@ static void BoxPruningKernelIntrinsics(PairOutputBuffer &POB, FloatOrInt32* BoxB
 		__m128 Box0MinY = _mm_set1_ps(PtrAddBytes(Box0Ptr, 0*BoxBytesP)->f);
 		__m128 Box0MaxZ = _mm_set1_ps(PtrAddBytes(Box0Ptr, 1*BoxBytesP)->f);
 		__m128 Box0MinZ = _mm_set1_ps(PtrAddBytes(Box0Ptr, 2*BoxBytesP)->f);
+		const SetFilterT Sets(Box0Ptr, BoxBytesP);
 
 		// Main loop
 		const FloatOrInt32 *Box1Ptr = RunningPtr;
@@ -348,7 +182,6 @@ static void BoxPruningKernelIntrinsics(PairOutputBuffer &POB, FloatOrInt32* BoxB
 			__m128 Box1MinY = _mm_loadu_ps(&PtrAddBytes(Box1Ptr, 0*BoxBytesP)->f);
 			__m128 Box1MaxZ = _mm_loadu_ps(&PtrAddBytes(Box1Ptr, 1*BoxBytesP)->f);
 			__m128 Box1MinZ = _mm_loadu_ps(&PtrAddBytes(Box1Ptr, 2*BoxBytesP)->f);
-			Box1Ptr += 4;
 
 			// Intersection test:
 			//  !(b.MaxY < a.MinY) && (b.MinY <= a.MaxY) && !(b.MaxZ < a.MinZ) && (b.MinZ <= a.MaxZ)
@@ -357,6 +190,8 @@ static void BoxPruningKernelIntrinsics(PairOutputBuffer &POB, FloatOrInt32* BoxB
 			Cmp = _mm_and_ps(Cmp, _mm_cmple_ps(Box1MinY, Box0MaxY));
 			Cmp = _mm_and_ps(Cmp, _mm_cmpnlt_ps(Box1MaxZ, Box0MinZ));
 			Cmp = _mm_and_ps(Cmp, _mm_cmple_ps(Box1MinZ, Box0MaxZ));
+			Cmp = Sets.Apply(Cmp, Box1Ptr, BoxBytesP);
+			Box1Ptr += 4;
 
 			int Mask = _mm_movemask_ps(Cmp);
 			if (Mask)
@@ -382,6 +217,7 @@ static void BoxPruningKernelIntrinsics(PairOutputBuffer &POB, FloatOrInt32* BoxB
 			Cmp = _mm_and_ps(Cmp, _mm_cmple_ps(Box1MinY, Box0MaxY));
 			Cmp = _mm_and_ps(Cmp, _mm_cmpnlt_ps(Box1MaxZ, Box0MinZ));
 			Cmp = _mm_and_ps(Cmp, _mm_cmple_ps(Box1MinZ, Box0MaxZ));
+			Cmp = Sets.Apply(Cmp, Box1Ptr, BoxBytesP);
 
 			int Mask = _mm_movemask_ps(Cmp);
 			if (Mask)
@@ -391,6 +227,17 @@ static void BoxPruningKernelIntrinsics(PairOutputBuffer &POB, FloatOrInt32* BoxB
 	}
 }
 
+static void BoxPruningKernelIntrinsics(PairOutputBuffer &POB, FloatOrInt32* BoxBase, FloatOrInt32* BoxEnd, udword* Remap, ptrdiff_t BoxBytesP)
+{
+	BoxPruningKernelT<NoSetFilter>(POB, BoxBase, BoxEnd, Remap, BoxBytesP);
+}
+
+// Same as BoxPruningKernelIntrinsics, but pairs of boxes from the same set are rejected. Used by the k-partite and bipartite paths.
+static void BoxPruningKernelKPartite(PairOutputBuffer &POB, FloatOrInt32* BoxBase, FloatOrInt32* BoxEnd, udword* Remap, ptrdiff_t BoxBytesP)
+{
+	BoxPruningKernelT<SetFilter>(POB, BoxBase, BoxEnd, Remap, BoxBytesP);
+}
+
 static void BoxPruningKernelSSE2(PairOutputBuffer &POB, FloatOrInt32* BoxBase, FloatOrInt32* BoxEnd, udword* Remap, ptrdiff_t BoxBytesP)
 {
 	FloatOrInt32 *RunningPtr = BoxBase;
@@ -819,123 +666,1665 @@ AllDone:
 	}
 }
 
-///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-/**
- *	Complete box pruning. Returns a list of overlapping pairs of boxes, each box of the pair belongs to the same set.
- *	\param		nb		[in] number of boxes
- *	\param		list	[in] list of boxes
- *	\param		pairs	[out] list of overlapping pairs
- *	\param		axes	[in] projection order (0,2,1 is often best)
- *	\return		true if success.
- */
-///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-bool Meshmerizer::CompleteBoxPruning(udword nb, const AABB* list, Container& pairs)
+// Prefetch distance of the SoA build, in boxes
+static const udword kSOAPrefetchDistance = 16;
+
+// Below this number of boxes per thread, the SoA build is done on the calling thread only
+static const udword kMinBoxesPerSOAJob = 32768;
+
+// Number of entries per SoA array for nb boxes: aligned up to a multiple of 8, plus an extra 8 of padding.
+static inline udword GetPaddedSize(udword nb)
 {
-	// Checkings
-	if(!nb || !list)
-		return false;
+	return (nb+15) & ~7;
+}
 
-	udword nbpad = (nb+15) & ~7; // Align up to multiple of 8, and add an extra 8 of padding.
-	ptrdiff_t BoxBytesP = nbpad*sizeof(FloatOrInt32);
+// Prepares the SoA box array, fetching the boxes in the order given by Remap.
+// BoxBase points at the MinY array, arrays are BoxBytesP bytes apart. Entries between nb and nbpad are padding.
+// If end_list is not null, the SoA gets the union of the boxes from both lists (swept boxes).
+// If distance is not zero, the boxes are inflated so that the kernel reports pairs closer than distance on all axes. Boxes
+// are sorted by MinX and the kernel only tests Box1.MinX<=Box0.MaxX, so MaxX is moved by the full distance, while Y/Z are
+// tested both ways and are inflated by half the distance on both sides.
+static void BuildBoxSOA(FloatOrInt32* BoxBase, ptrdiff_t BoxBytesP, udword nb, udword nbpad, const AABB* list, const udword* Remap, const AABB* end_list=null, float distance=0.0f)
+{
 	ptrdiff_t BoxBytesN = -BoxBytesP;
 	ptrdiff_t BoxBytes3N = 3*BoxBytesN;
+	const float HalfDistance = distance*0.5f;
+	const __m128 Distance4 = _mm_set1_ps(distance);
+	const __m128 HalfDistance4 = _mm_set1_ps(HalfDistance);
 
-	// Our pair output buffer
-	PairOutputBuffer POB(pairs);
-
-	// BoxSOA: in order, arrays for MaxX,MinX (int), MaxY,MinY,MaxZ,MinZ (float).
-	FloatOrInt32* BoxSOA = (FloatOrInt32*)_aligned_malloc(BoxBytesP * 6, 32);
-
-	// Our default origin is actually pointing at array number 3 (MinY).
-	FloatOrInt32* BoxBase = PtrAddBytes(BoxSOA, 3*BoxBytesP);
-	FloatOrInt32* BoxEnd = BoxBase + nb;
+	// The gathers through Remap are cache misses for large inputs, so we prefetch the boxes a few iterations ahead
+	const udword PrefetchEnd = nb>kSOAPrefetchDistance+4 ? nb - kSOAPrefetchDistance - 4 : 0;
 
-	udword* Remap;
+	udword i;
+	for(i=0;i<(nb & ~3);i += 4)
 	{
-		// Allocate some temporary data
-		float* PosList = new float[nb+1];
-
-		// 1) Build main list using the primary axis
-		for(udword i=0;i<nb;i++)
-			PosList[i] = list[i].mMin.x;
-		PosList[nb] = FLT_MAX;
+		if(i<PrefetchEnd)
+		{
+			const udword* Ahead = Remap + i + kSOAPrefetchDistance;
+			_mm_prefetch((const char*)&list[Ahead[0]], _MM_HINT_T0);
+			_mm_prefetch((const char*)&list[Ahead[1]], _MM_HINT_T0);
+			_mm_prefetch((const char*)&list[Ahead[2]], _MM_HINT_T0);
+			_mm_prefetch((const char*)&list[Ahead[3]], _MM_HINT_T0);
+			if(end_list)
+			{
+				_mm_prefetch((const char*)&end_list[Ahead[0]], _MM_HINT_T0);
+				_mm_prefetch((const char*)&end_list[Ahead[1]], _MM_HINT_T0);
+				_mm_prefetch((const char*)&end_list[Ahead[2]], _MM_HINT_T0);
+				_mm_prefetch((const char*)&end_list[Ahead[3]], _MM_HINT_T0);
+			}
+		}
 
-		// 2) Sort the list
-		static PRUNING_SORTER RS;	// Static for coherence
-		Remap = RS.Sort(PosList, nb+1).GetRanks();
+		const AABB& Box0 = list[Remap[i+0]];
+		const AABB& Box1 = list[Remap[i+1]];
+		const AABB& Box2 = list[Remap[i+2]];
+		const AABB& Box3 = list[Remap[i+3]];
+		FloatOrInt32 *OutBoxI = &BoxBase[i];
+		__m128 r0,r1,r2,r3;
+		__m128i i0,i1;
+
+		r0 = _mm_loadu_ps(&Box0.mMin.x);
+		r1 = _mm_loadu_ps(&Box1.mMin.x);
+		r2 = _mm_loadu_ps(&Box2.mMin.x);
+		r3 = _mm_loadu_ps(&Box3.mMin.x);
+		_MM_TRANSPOSE4_PS(r0,r1,r2,r3); // r0 = MinX, r1 = MinY, r2 = MinZ, r3 = MaxX
+		if(end_list)
+		{
+			__m128 e0 = _mm_loadu_ps(&end_list[Remap[i+0]].mMin.x);
+			__m128 e1 = _mm_loadu_ps(&end_list[Remap[i+1]].mMin.x);
+			__m128 e2 = _mm_loadu_ps(&end_list[Remap[i+2]].mMin.x);
+			__m128 e3 = _mm_loadu_ps(&end_list[Remap[i+3]].mMin.x);
+			_MM_TRANSPOSE4_PS(e0,e1,e2,e3);
+			r0 = _mm_min_ps(r0, e0);
+			r1 = _mm_min_ps(r1, e1);
+			r2 = _mm_min_ps(r2, e2);
+			r3 = _mm_max_ps(r3, e3);
+		}
+		if(distance!=0.0f)
+		{
+			r1 = _mm_sub_ps(r1, HalfDistance4);
+			r2 = _mm_sub_ps(r2, HalfDistance4);
+			r3 = _mm_add_ps(r3, Distance4);
+		}
 
-		// 3) Prepare the SoA box array
-		udword i;
-		for(i=0;i<(nb & ~3);i += 4)
+		i0 = MungeFloatSSE(r0); // munged MinX
+		i1 = MungeFloatSSE(r3); // munged MaxX
+		_mm_store_si128((__m128i *) &PtrAddBytes(OutBoxI, 2*BoxBytesN)->s, i0); // MinX
+		_mm_store_si128((__m128i *) &PtrAddBytes(OutBoxI,  BoxBytes3N)->s, i1); // MaxX
+		_mm_store_ps(&PtrAddBytes(OutBoxI, 0*BoxBytesP)->f, r1); // MinY
+		_mm_store_ps(&PtrAddBytes(OutBoxI, 2*BoxBytesP)->f, r2); // MinZ
+
+		r0 = _mm_castsi128_ps(_mm_loadl_epi64((const __m128i *)&Box0.mMax.y));
+		r1 = _mm_castsi128_ps(_mm_loadl_epi64((const __m128i *)&Box1.mMax.y));
+		r2 = _mm_castsi128_ps(_mm_loadl_epi64((const __m128i *)&Box2.mMax.y));
+		r3 = _mm_castsi128_ps(_mm_loadl_epi64((const __m128i *)&Box3.mMax.y));
+		_MM_TRANSPOSE4_PS(r0,r1,r2,r3); // r0 = MaxY, r1=MaxZ
+		if(end_list)
+		{
+			__m128 e0 = _mm_castsi128_ps(_mm_loadl_epi64((const __m128i *)&end_list[Remap[i+0]].mMax.y));
+			__m128 e1 = _mm_castsi128_ps(_mm_loadl_epi64((const __m128i *)&end_list[Remap[i+1]].mMax.y));
+			__m128 e2 = _mm_castsi128_ps(_mm_loadl_epi64((const __m128i *)&end_list[Remap[i+2]].mMax.y));
+			__m128 e3 = _mm_castsi128_ps(_mm_loadl_epi64((const __m128i *)&end_list[Remap[i+3]].mMax.y));
+			_MM_TRANSPOSE4_PS(e0,e1,e2,e3);
+			r0 = _mm_max_ps(r0, e0);
+			r1 = _mm_max_ps(r1, e1);
+		}
+		if(distance!=0.0f)
 		{
-			const AABB& Box0 = list[Remap[i+0]];
-			const AABB& Box1 = list[Remap[i+1]];
-			const AABB& Box2 = list[Remap[i+2]];
-			const AABB& Box3 = list[Remap[i+3]];
-			FloatOrInt32 *OutBoxI = &BoxBase[i];
-			__m128 r0,r1,r2,r3;
-			__m128i i0,i1;
-
-			r0 = _mm_loadu_ps(&Box0.mMin.x);
-			r1 = _mm_loadu_ps(&Box1.mMin.x);
-			r2 = _mm_loadu_ps(&Box2.mMin.x);
-			r3 = _mm_loadu_ps(&Box3.mMin.x);
-			_MM_TRANSPOSE4_PS(r0,r1,r2,r3); // r0 = MinX, r1 = MinY, r2 = MinZ, r3 = MaxX
-
-			i0 = MungeFloatSSE(r0); // munged MinX
-			i1 = MungeFloatSSE(r3); // munged MaxX
-			_mm_store_si128((__m128i *) &PtrAddBytes(OutBoxI, 2*BoxBytesN)->s, i0); // MinX
-			_mm_store_si128((__m128i *) &PtrAddBytes(OutBoxI,  BoxBytes3N)->s, i1); // MaxX
-			_mm_store_ps(&PtrAddBytes(OutBoxI, 0*BoxBytesP)->f, r1); // MinY
-			_mm_store_ps(&PtrAddBytes(OutBoxI, 2*BoxBytesP)->f, r2); // MinZ
-
-			r0 = _mm_castsi128_ps(_mm_loadl_epi64((const __m128i *)&Box0.mMax.y));
-			r1 = _mm_castsi128_ps(_mm_loadl_epi64((const __m128i *)&Box1.mMax.y));
-			r2 = _mm_castsi128_ps(_mm_loadl_epi64((const __m128i *)&Box2.mMax.y));
-			r3 = _mm_castsi128_ps(_mm_loadl_epi64((const __m128i *)&Box3.mMax.y));
-			_MM_TRANSPOSE4_PS(r0,r1,r2,r3); // r0 = MaxY, r1=MaxZ
-			_mm_store_ps(&PtrAddBytes(OutBoxI, 1*BoxBytesN)->f, r0); // MaxY
-			_mm_store_ps(&PtrAddBytes(OutBoxI, 1*BoxBytesP)->f, r1); // MaxZ
+			r0 = _mm_add_ps(r0, HalfDistance4);
+			r1 = _mm_add_ps(r1, HalfDistance4);
 		}
-		for(;i<nb;i++)
+		_mm_store_ps(&PtrAddBytes(OutBoxI, 1*BoxBytesN)->f, r0); // MaxY
+		_mm_store_ps(&PtrAddBytes(OutBoxI, 1*BoxBytesP)->f, r1); // MaxZ
+	}
+	for(;i<nb;i++)
+	{
+		AABB Box = list[Remap[i]];
+		if(end_list)
 		{
-			const AABB& Box = list[Remap[i]];
-			FloatOrInt32 *OutBoxI = &BoxBase[i];
-			PtrAddBytes(OutBoxI,  BoxBytes3N)->s = MungeFloat(Box.mMax.x);
-			PtrAddBytes(OutBoxI, 2*BoxBytesN)->s = MungeFloat(Box.mMin.x);
-			PtrAddBytes(OutBoxI, 1*BoxBytesN)->f = Box.mMax.y;
-			PtrAddBytes(OutBoxI, 0*BoxBytesP)->f = Box.mMin.y;
-			PtrAddBytes(OutBoxI, 1*BoxBytesP)->f = Box.mMax.z;
-			PtrAddBytes(OutBoxI, 2*BoxBytesP)->f = Box.mMin.z;
+			Box.mMin.Min(end_list[Remap[i]].mMin);
+			Box.mMax.Max(end_list[Remap[i]].mMax);
 		}
-		for(;i<nbpad;i++)
+		if(distance!=0.0f)
 		{
-			FloatOrInt32 *OutBoxI = &BoxBase[i];
-			PtrAddBytes(OutBoxI,  BoxBytes3N)->s = -0x80000000;
-			PtrAddBytes(OutBoxI, 2*BoxBytesN)->s = 0x7fffffff;
-			PtrAddBytes(OutBoxI, 1*BoxBytesN)->f = -FLT_MAX;
-			PtrAddBytes(OutBoxI, 0*BoxBytesP)->f = FLT_MAX;
-			PtrAddBytes(OutBoxI, 1*BoxBytesP)->f = -FLT_MAX;
-			PtrAddBytes(OutBoxI, 2*BoxBytesP)->f = FLT_MAX;
+			Box.mMin.y -= HalfDistance;	Box.mMin.z -= HalfDistance;
+			Box.mMax.y += HalfDistance;	Box.mMax.z += HalfDistance;
+			Box.mMax.x += distance;
 		}
-		DELETEARRAY(PosList);
+		FloatOrInt32 *OutBoxI = &BoxBase[i];
+		PtrAddBytes(OutBoxI,  BoxBytes3N)->s = MungeFloat(Box.mMax.x);
+		PtrAddBytes(OutBoxI, 2*BoxBytesN)->s = MungeFloat(Box.mMin.x);
+		PtrAddBytes(OutBoxI, 1*BoxBytesN)->f = Box.mMax.y;
+		PtrAddBytes(OutBoxI, 0*BoxBytesP)->f = Box.mMin.y;
+		PtrAddBytes(OutBoxI, 1*BoxBytesP)->f = Box.mMax.z;
+		PtrAddBytes(OutBoxI, 2*BoxBytesP)->f = Box.mMin.z;
+	}
+	for(;i<nbpad;i++)
+	{
+		FloatOrInt32 *OutBoxI = &BoxBase[i];
+		PtrAddBytes(OutBoxI,  BoxBytes3N)->s = -0x80000000;
+		PtrAddBytes(OutBoxI, 2*BoxBytesN)->s = 0x7fffffff;
+		PtrAddBytes(OutBoxI, 1*BoxBytesN)->f = -FLT_MAX;
+		PtrAddBytes(OutBoxI, 0*BoxBytesP)->f = FLT_MAX;
+		PtrAddBytes(OutBoxI, 1*BoxBytesP)->f = -FLT_MAX;
+		PtrAddBytes(OutBoxI, 2*BoxBytesP)->f = FLT_MAX;
 	}
+}
 
-	// 4) Prune the list
+// One range of a parallel SoA build
+struct SOABuildJob
+{
+	ThreadPoolJob		mJob;
+	FloatOrInt32*		mBoxBase;
+	ptrdiff_t			mBoxBytesP;
+	udword				mNb;
+	udword				mNbPad;
+	const AABB*			mList;
+	const udword*		mRemap;
+	float				mDistance;
+	volatile long*		mNbPending;
+	void*				mEvent;
+};
+
+static void BuildBoxSOARange(void* user_data)
+{
+	SOABuildJob* Job = (SOABuildJob*)user_data;
+	BuildBoxSOA(Job->mBoxBase, Job->mBoxBytesP, Job->mNb, Job->mNbPad, Job->mList, Job->mRemap, null, Job->mDistance);
+	if(!InterlockedDecrement(Job->mNbPending))
+		SetEvent(Job->mEvent);
+}
+
+// Same as BuildBoxSOA, but large inputs are split by output range across the shared thread pool, if enabled with
+// ConfigureBoxPruningThreadPool. The calling thread builds the first range. Ranges start on multiples of 4 boxes to keep the
+// SoA stores aligned, and the last one does the padding. Single-threaded when called from a pool job.
+static void BuildBoxSOAParallel(FloatOrInt32* BoxBase, ptrdiff_t BoxBytesP, udword nb, udword nbpad, const AABB* list, const udword* Remap, float distance)
+{
+	ThreadPool* Pool = nb>=2*kMinBoxesPerSOAJob ? GetBoxPruningHelperPool() : null;
+	const udword NbJobs = Pool ? TMin(Pool->GetNbThreads()+1, nb/kMinBoxesPerSOAJob) : 1;
+	if(NbJobs<2)
+	{
+		BuildBoxSOA(BoxBase, BoxBytesP, nb, nbpad, list, Remap, null, distance);
+		return;
+	}
+
+	void* Event = CreateEventA(null, TRUE, FALSE, null);
+	if(!Event)
+	{
+		BuildBoxSOA(BoxBase, BoxBytesP, nb, nbpad, list, Remap, null, distance);
+		return;
+	}
+
+	const udword RangeSize = ((nb/NbJobs)+3) & ~3;
+	SOABuildJob* Jobs = new SOABuildJob[NbJobs];
+	volatile long NbPending = NbJobs - 1;
+	for(udword i=0;i<NbJobs;i++)
+	{
+		const udword Start = i*RangeSize;
+		const bool Last = i==NbJobs-1;
+		SOABuildJob& Job = Jobs[i];
+		Job.mBoxBase	= BoxBase + Start;
+		Job.mBoxBytesP	= BoxBytesP;
+		Job.mNb			= Last ? nb - Start : RangeSize;
+		Job.mNbPad		= Last ? nbpad - Start : RangeSize;
+		Job.mList		= list;
+		Job.mRemap		= Remap + Start;
+		Job.mDistance	= distance;
+		Job.mNbPending	= &NbPending;
+		Job.mEvent		= Event;
+		Job.mJob.mFunction	= BuildBoxSOARange;
+		Job.mJob.mUserData	= &Job;
+	}
+
+	for(udword i=1;i<NbJobs;i++)
+		Pool->Submit(Jobs[i].mJob);
+
+	BuildBoxSOA(Jobs[0].mBoxBase, BoxBytesP, Jobs[0].mNb, Jobs[0].mNbPad, list, Remap, null, distance);
+
+	WaitForSingleObject(Event, INFINITE);
+	CloseHandle(Event);
+	DELETEARRAY(Jobs);
+}
+
+// Same as BuildBoxSOA, for boxes given as separate arrays of bounds. There's no transpose needed, we just gather the
+// bounds in sorted order.
+static void BuildBoxSOAFromArrays(FloatOrInt32* BoxBase, ptrdiff_t BoxBytesP, udword nb, udword nbpad, const float* min_x, const float* min_y, const float* min_z, const float* max_x, const float* max_y, const float* max_z, const udword* Remap)
+{
+	ptrdiff_t BoxBytesN = -BoxBytesP;
+	ptrdiff_t BoxBytes3N = 3*BoxBytesN;
+
+	udword i;
+	for(i=0;i<(nb & ~3);i += 4)
+	{
+		const udword i0 = Remap[i+0];
+		const udword i1 = Remap[i+1];
+		const udword i2 = Remap[i+2];
+		const udword i3 = Remap[i+3];
+		FloatOrInt32 *OutBoxI = &BoxBase[i];
+
+		_mm_store_si128((__m128i *) &PtrAddBytes(OutBoxI, 2*BoxBytesN)->s, MungeFloatSSE(_mm_setr_ps(min_x[i0], min_x[i1], min_x[i2], min_x[i3]))); // MinX
+		_mm_store_si128((__m128i *) &PtrAddBytes(OutBoxI,  BoxBytes3N)->s, MungeFloatSSE(_mm_setr_ps(max_x[i0], max_x[i1], max_x[i2], max_x[i3]))); // MaxX
+		_mm_store_ps(&PtrAddBytes(OutBoxI, 1*BoxBytesN)->f, _mm_setr_ps(max_y[i0], max_y[i1], max_y[i2], max_y[i3])); // MaxY
+		_mm_store_ps(&PtrAddBytes(OutBoxI, 0*BoxBytesP)->f, _mm_setr_ps(min_y[i0], min_y[i1], min_y[i2], min_y[i3])); // MinY
+		_mm_store_ps(&PtrAddBytes(OutBoxI, 1*BoxBytesP)->f, _mm_setr_ps(max_z[i0], max_z[i1], max_z[i2], max_z[i3])); // MaxZ
+		_mm_store_ps(&PtrAddBytes(OutBoxI, 2*BoxBytesP)->f, _mm_setr_ps(min_z[i0], min_z[i1], min_z[i2], min_z[i3])); // MinZ
+	}
+	for(;i<nb;i++)
+	{
+		const udword Index = Remap[i];
+		FloatOrInt32 *OutBoxI = &BoxBase[i];
+		PtrAddBytes(OutBoxI,  BoxBytes3N)->s = MungeFloat(max_x[Index]);
+		PtrAddBytes(OutBoxI, 2*BoxBytesN)->s = MungeFloat(min_x[Index]);
+		PtrAddBytes(OutBoxI, 1*BoxBytesN)->f = max_y[Index];
+		PtrAddBytes(OutBoxI, 0*BoxBytesP)->f = min_y[Index];
+		PtrAddBytes(OutBoxI, 1*BoxBytesP)->f = max_z[Index];
+		PtrAddBytes(OutBoxI, 2*BoxBytesP)->f = min_z[Index];
+	}
+	for(;i<nbpad;i++)
+	{
+		FloatOrInt32 *OutBoxI = &BoxBase[i];
+		PtrAddBytes(OutBoxI,  BoxBytes3N)->s = -0x80000000;
+		PtrAddBytes(OutBoxI, 2*BoxBytesN)->s = 0x7fffffff;
+		PtrAddBytes(OutBoxI, 1*BoxBytesN)->f = -FLT_MAX;
+		PtrAddBytes(OutBoxI, 0*BoxBytesP)->f = FLT_MAX;
+		PtrAddBytes(OutBoxI, 1*BoxBytesP)->f = -FLT_MAX;
+		PtrAddBytes(OutBoxI, 2*BoxBytesP)->f = FLT_MAX;
+	}
+}
+
+// Same as BuildBoxSOA, for the bipartite version. Remap contains merged indices: below nb0 they select a box from list0,
+// otherwise from list1 at index - nb0. The set tag of each box (0 for list0, ~0 for list1) is written to a 7th array after MinZ.
+static void BuildBoxSOABipartite(FloatOrInt32* BoxBase, ptrdiff_t BoxBytesP, udword nb, udword nbpad, udword nb0, const AABB* list0, const AABB* list1, const udword* Remap)
+{
+	ptrdiff_t BoxBytesN = -BoxBytesP;
+	ptrdiff_t BoxBytes3N = 3*BoxBytesN;
+
+	const udword PrefetchEnd = nb>kSOAPrefetchDistance+4 ? nb - kSOAPrefetchDistance - 4 : 0;
+
+	udword i;
+	for(i=0;i<(nb & ~3);i += 4)
+	{
+		if(i<PrefetchEnd)
+		{
+			const udword* Ahead = Remap + i + kSOAPrefetchDistance;
+			for(udword j=0;j<4;j++)
+				_mm_prefetch((const char*)(Ahead[j]<nb0 ? &list0[Ahead[j]] : &list1[Ahead[j]-nb0]), _MM_HINT_T0);
+		}
+
+		const udword i0 = Remap[i+0];
+		const udword i1 = Remap[i+1];
+		const udword i2 = Remap[i+2];
+		const udword i3 = Remap[i+3];
+		const AABB& Box0 = i0<nb0 ? list0[i0] : list1[i0-nb0];
+		const AABB& Box1 = i1<nb0 ? list0[i1] : list1[i1-nb0];
+		const AABB& Box2 = i2<nb0 ? list0[i2] : list1[i2-nb0];
+		const AABB& Box3 = i3<nb0 ? list0[i3] : list1[i3-nb0];
+		FloatOrInt32 *OutBoxI = &BoxBase[i];
+		__m128 r0,r1,r2,r3;
+
+		r0 = _mm_loadu_ps(&Box0.mMin.x);
+		r1 = _mm_loadu_ps(&Box1.mMin.x);
+		r2 = _mm_loadu_ps(&Box2.mMin.x);
+		r3 = _mm_loadu_ps(&Box3.mMin.x);
+		_MM_TRANSPOSE4_PS(r0,r1,r2,r3); // r0 = MinX, r1 = MinY, r2 = MinZ, r3 = MaxX
+		_mm_store_si128((__m128i *) &PtrAddBytes(OutBoxI, 2*BoxBytesN)->s, MungeFloatSSE(r0)); // MinX
+		_mm_store_si128((__m128i *) &PtrAddBytes(OutBoxI,  BoxBytes3N)->s, MungeFloatSSE(r3)); // MaxX
+		_mm_store_ps(&PtrAddBytes(OutBoxI, 0*BoxBytesP)->f, r1); // MinY
+		_mm_store_ps(&PtrAddBytes(OutBoxI, 2*BoxBytesP)->f, r2); // MinZ
+
+		r0 = _mm_castsi128_ps(_mm_loadl_epi64((const __m128i *)&Box0.mMax.y));
+		r1 = _mm_castsi128_ps(_mm_loadl_epi64((const __m128i *)&Box1.mMax.y));
+		r2 = _mm_castsi128_ps(_mm_loadl_epi64((const __m128i *)&Box2.mMax.y));
+		r3 = _mm_castsi128_ps(_mm_loadl_epi64((const __m128i *)&Box3.mMax.y));
+		_MM_TRANSPOSE4_PS(r0,r1,r2,r3); // r0 = MaxY, r1=MaxZ
+		_mm_store_ps(&PtrAddBytes(OutBoxI, 1*BoxBytesN)->f, r0); // MaxY
+		_mm_store_ps(&PtrAddBytes(OutBoxI, 1*BoxBytesP)->f, r1); // MaxZ
+
+		const __m128i Tags = _mm_setr_epi32(i0<nb0 ? 0 : -1, i1<nb0 ? 0 : -1, i2<nb0 ? 0 : -1, i3<nb0 ? 0 : -1);
+		_mm_store_si128((__m128i *) &PtrAddBytes(OutBoxI, 3*BoxBytesP)->s, Tags); // Set tags
+	}
+	for(;i<nb;i++)
+	{
+		const udword Index = Remap[i];
+		const AABB& Box = Index<nb0 ? list0[Index] : list1[Index-nb0];
+		FloatOrInt32 *OutBoxI = &BoxBase[i];
+		PtrAddBytes(OutBoxI,  BoxBytes3N)->s = MungeFloat(Box.mMax.x);
+		PtrAddBytes(OutBoxI, 2*BoxBytesN)->s = MungeFloat(Box.mMin.x);
+		PtrAddBytes(OutBoxI, 1*BoxBytesN)->f = Box.mMax.y;
+		PtrAddBytes(OutBoxI, 0*BoxBytesP)->f = Box.mMin.y;
+		PtrAddBytes(OutBoxI, 1*BoxBytesP)->f = Box.mMax.z;
+		PtrAddBytes(OutBoxI, 2*BoxBytesP)->f = Box.mMin.z;
+		PtrAddBytes(OutBoxI, 3*BoxBytesP)->s = Index<nb0 ? 0 : -1;
+	}
+	// Padding boxes never overlap anything, their set tags don't matter
+	for(;i<nbpad;i++)
+	{
+		FloatOrInt32 *OutBoxI = &BoxBase[i];
+		PtrAddBytes(OutBoxI,  BoxBytes3N)->s = -0x80000000;
+		PtrAddBytes(OutBoxI, 2*BoxBytesN)->s = 0x7fffffff;
+		PtrAddBytes(OutBoxI, 1*BoxBytesN)->f = -FLT_MAX;
+		PtrAddBytes(OutBoxI, 0*BoxBytesP)->f = FLT_MAX;
+		PtrAddBytes(OutBoxI, 1*BoxBytesP)->f = -FLT_MAX;
+		PtrAddBytes(OutBoxI, 2*BoxBytesP)->f = FLT_MAX;
+		PtrAddBytes(OutBoxI, 3*BoxBytesP)->s = 0;
+	}
+}
+
+typedef void (*BoxPruningKernel)(PairOutputBuffer &POB, FloatOrInt32* BoxBase, FloatOrInt32* BoxEnd, udword* Remap, ptrdiff_t BoxBytesP);
+
+// Picks the kernel for this CPU. Callers running the kernel many times should only do this once.
+static BoxPruningKernel SelectBoxPruningKernel()
+{
 #if 0
-	BoxPruningKernelIntrinsics(POB, BoxBase, BoxEnd, Remap, BoxBytesP);
+	return BoxPruningKernelIntrinsics;
 #else
 	int info[4];
 	__cpuid(info, 1);
 
 	// Use AVX if CPU and OS support it
 	if (0 && (info[2] & 0x18000000) == 0x18000000)
-		BoxPruningKernelAVX(POB, BoxBase, BoxEnd, Remap, BoxBytesP);
+		return BoxPruningKernelAVX;
 	else
-		BoxPruningKernelSSE2(POB, BoxBase, BoxEnd, Remap, BoxBytesP);
+		return BoxPruningKernelSSE2;
 #endif
+}
+
+// Shared by the complete box pruning versions, pairs go to the given output buffer. The sorter is passed by the caller so that
+// the asynchronous version can use its own. The SoA build may run on the thread pool if parallel_build is true.
+template<class SorterT>
+static void CompleteBoxPruning(PairOutputBuffer& POB, SorterT& RS, udword nb, const AABB* list, float distance, bool parallel_build)
+{
+	udword nbpad = GetPaddedSize(nb);
+	ptrdiff_t BoxBytesP = nbpad*sizeof(FloatOrInt32);
+
+	// BoxSOA: in order, arrays for MaxX,MinX (int), MaxY,MinY,MaxZ,MinZ (float).
+	FloatOrInt32* BoxSOA = (FloatOrInt32*)_aligned_malloc(BoxBytesP * 6, 32);
+
+	// Our default origin is actually pointing at array number 3 (MinY).
+	FloatOrInt32* BoxBase = PtrAddBytes(BoxSOA, 3*BoxBytesP);
+	FloatOrInt32* BoxEnd = BoxBase + nb;
+
+	// 1-2) Sort the boxes along the primary axis. The sorter reads the boxes directly, no need for a temporary list.
+	udword* Remap = RS.Sort(&list[0].mMin.x, nb, sizeof(AABB)).GetRanks();
+
+	// 3) Prepare the SoA box array
+	if(parallel_build)
+		BuildBoxSOAParallel(BoxBase, BoxBytesP, nb, nbpad, list, Remap, distance);
+	else
+		BuildBoxSOA(BoxBase, BoxBytesP, nb, nbpad, list, Remap, null, distance);
+
+	// 4) Prune the list
+	SelectBoxPruningKernel()(POB, BoxBase, BoxEnd, Remap, BoxBytesP);
 
 	_aligned_free(BoxSOA);
-	return true;
 }
 
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+ *	Complete box pruning. Returns a list of overlapping pairs of boxes, each box of the pair belongs to the same set.
+ *	\param		nb		[in] number of boxes
+ *	\param		list	[in] list of boxes
+ *	\param		pairs	[out] list of overlapping pairs
+ *	\param		axes	[in] projection order (0,2,1 is often best)
+ *	\return		true if success.
+ */
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+bool Meshmerizer::CompleteBoxPruning(udword nb, const AABB* list, Container& pairs)
+{
+	return CompleteBoxPruningInflated(nb, list, pairs, 0.0f);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+ *	Complete box pruning with a user-provided sorter. Same as CompleteBoxPruning, but the caller owns the sorter, so its coherence
+ *	isn't shared with the other callers, and its ranks give the sorted order of the boxes after the call.
+ *	\param		nb		[in] number of boxes
+ *	\param		list	[in] list of boxes
+ *	\param		pairs	[out] list of overlapping pairs
+ *	\param		sorter	[in] sorter used for the primary axis
+ *	\return		true if success.
+ */
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+bool Meshmerizer::CompleteBoxPruningWithSorter(udword nb, const AABB* list, Container& pairs, PRUNING_SORTER& sorter)
+{
+	// Checkings
+	if(!nb || !list)
+		return false;
+
+	// Our pair output buffer
+	PairOutputBuffer POB(pairs);
+
+	CompleteBoxPruning(POB, sorter, nb, list, 0.0f, true);
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+ *	Complete box pruning with inflated boxes. Returns the pairs of boxes closer than a given distance on each axis, i.e. the boxes
+ *	that would overlap after being inflated by distance/2 on all sides. The inflation is done while building the SoA array, so
+ *	there's no need to allocate an inflated copy of the boxes, and the same kernel is used. Passing zero is the same as calling
+ *	CompleteBoxPruning.
+ *	\param		nb			[in] number of boxes
+ *	\param		list		[in] list of boxes
+ *	\param		pairs		[out] list of overlapping pairs
+ *	\param		distance	[in] distance between boxes below which they are reported
+ *	\return		true if success.
+ */
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+bool Meshmerizer::CompleteBoxPruningInflated(udword nb, const AABB* list, Container& pairs, float distance)
+{
+	// Checkings
+	if(!nb || !list)
+		return false;
+
+	// Our pair output buffer
+	PairOutputBuffer POB(pairs);
+
+	static PRUNING_SORTER RS;	// Static for coherence
+	RS.SetMode(RADIX_AUTO);
+	CompleteBoxPruning(POB, RS, nb, list, distance, true);
+	return true;
+}
+
+// Integer region bounds of a box, in the Multi-SAP's YZ region grid
+struct RegionBounds
+{
+	udword	mMinY, mMinZ;
+	udword	mMaxY, mMaxZ;
+};
+
+static inline_ udword RegionCoord(float f, float world_min, float inv_region_size, udword nb_regions)
+{
+	const float r = (f - world_min) * inv_region_size;
+	if(!(r>0.0f))
+		return 0;
+	const udword c = udword(r);
+	return c<nb_regions ? c : nb_regions-1;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+ *	Multi-SAP box pruning. Same results as CompleteBoxPruning, but the world is split into a coarse grid of regions in the YZ plane,
+ *	and each region is swept separately with the regular kernel. Boxes straddling several regions are added to all of them. This keeps
+ *	boxes that are far apart in Y/Z out of each other's sweep, which shortens the inner loops in large worlds.
+ *
+ *	Boxes are only sorted once: the sorted list is distributed to the regions with a counting sort, which preserves the X order.
+ *	Duplicate pairs are removed by only keeping a pair in the region containing the min corner of the two boxes' region ranges.
+ *	Regions are independent of each other so this is also a natural unit of work for a multithreaded version.
+ *
+ *	\param		nb				[in] number of boxes
+ *	\param		list			[in] list of boxes
+ *	\param		pairs			[out] list of overlapping pairs
+ *	\param		nb_regions_y	[in] number of regions along Y
+ *	\param		nb_regions_z	[in] number of regions along Z
+ *	\return		true if success, false if the regions would need 2^31 entries or more.
+ */
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+bool Meshmerizer::MultiSAPBoxPruning(udword nb, const AABB* list, Container& pairs, udword nb_regions_y, udword nb_regions_z)
+{
+	// Checkings
+	if(!nb || !list || !nb_regions_y || !nb_regions_z)
+		return false;
+
+	if(nb_regions_y==1 && nb_regions_z==1)
+		return CompleteBoxPruning(nb, list, pairs);
+
+	// 1) Compute the world bounds in the YZ plane, and the region bounds of each box
+	float MinY = list[0].mMin.y, MaxY = list[0].mMax.y;
+	float MinZ = list[0].mMin.z, MaxZ = list[0].mMax.z;
+	for(udword i=1;i<nb;i++)
+	{
+		MinY = TMin(MinY, list[i].mMin.y);	MaxY = TMax(MaxY, list[i].mMax.y);
+		MinZ = TMin(MinZ, list[i].mMin.z);	MaxZ = TMax(MaxZ, list[i].mMax.z);
+	}
+	const float InvRegionSizeY = MaxY>MinY ? float(nb_regions_y) / (MaxY - MinY) : 0.0f;
+	const float InvRegionSizeZ = MaxZ>MinZ ? float(nb_regions_z) / (MaxZ - MinZ) : 0.0f;
+
+	// Regions and region entries are counted with udwords
+	if(uqword(nb_regions_y)*nb_regions_z>=0x80000000)
+		return false;
+
+	const udword NbRegions = nb_regions_y * nb_regions_z;
+	udword* Offsets = new udword[NbRegions+1];
+	ZeroMemory(Offsets, (NbRegions+1)*sizeof(udword));
+
+	RegionBounds* Bounds = new RegionBounds[nb];
+	uqword NbEntries = 0;
+	for(udword i=0;i<nb;i++)
+	{
+		const AABB& Box = list[i];
+		RegionBounds& RB = Bounds[i];
+		RB.mMinY = RegionCoord(Box.mMin.y, MinY, InvRegionSizeY, nb_regions_y);
+		RB.mMaxY = RegionCoord(Box.mMax.y, MinY, InvRegionSizeY, nb_regions_y);
+		RB.mMinZ = RegionCoord(Box.mMin.z, MinZ, InvRegionSizeZ, nb_regions_z);
+		RB.mMaxZ = RegionCoord(Box.mMax.z, MinZ, InvRegionSizeZ, nb_regions_z);
+
+		// Large boxes are added to many regions, the total can overflow even when the number of regions doesn't
+		NbEntries += uqword(RB.mMaxY - RB.mMinY + 1) * (RB.mMaxZ - RB.mMinZ + 1);
+		if(NbEntries>=0x80000000 - RADIX_RANKS_SLACK)
+		{
+			DELETEARRAY(Bounds);
+			DELETEARRAY(Offsets);
+			return false;
+		}
+
+		for(udword z=RB.mMinZ;z<=RB.mMaxZ;z++)
+		for(udword y=RB.mMinY;y<=RB.mMaxY;y++)
+			Offsets[z*nb_regions_y+y+1]++;
+	}
+
+	// Turn counts into offsets, and find the largest region
+	udword MaxNbInRegion = 0;
+	for(udword i=0;i<NbRegions;i++)
+	{
+		MaxNbInRegion = TMax(MaxNbInRegion, Offsets[i+1]);
+		Offsets[i+1] += Offsets[i];
+	}
+
+	// 2) Sort once along X, then distribute the sorted boxes to the regions. Each region's slice is used as the kernel's remap
+	// table, which reads it 4 entries at a time, so the last one needs the same slack as the sorter's ranks.
+	udword* RegionBoxes = new udword[Offsets[NbRegions]+RADIX_RANKS_SLACK];
+	ZeroMemory(RegionBoxes + Offsets[NbRegions], RADIX_RANKS_SLACK*sizeof(udword));
+	{
+		static PRUNING_SORTER RS;	// Static for coherence
+		RS.SetMode(RADIX_AUTO);
+		const udword* Sorted = RS.Sort(&list[0].mMin.x, nb, sizeof(AABB)).GetRanks();
+
+		udword* Cursor = new udword[NbRegions];
+		CopyMemory(Cursor, Offsets, NbRegions*sizeof(udword));
+		for(udword i=0;i<nb;i++)
+		{
+			const udword Index = Sorted[i];
+			const RegionBounds& RB = Bounds[Index];
+			for(udword z=RB.mMinZ;z<=RB.mMaxZ;z++)
+			for(udword y=RB.mMinY;y<=RB.mMaxY;y++)
+				RegionBoxes[Cursor[z*nb_regions_y+y]++] = Index;
+		}
+		DELETEARRAY(Cursor);
+	}
+
+	// 3) One SoA buffer, large enough for the largest region, reused by all of them
+	const udword nbpad = GetPaddedSize(MaxNbInRegion);
+	const ptrdiff_t BoxBytesP = nbpad*sizeof(FloatOrInt32);
+	FloatOrInt32* BoxSOA = (FloatOrInt32*)_aligned_malloc(BoxBytesP * 6, 32);
+	FloatOrInt32* BoxBase = PtrAddBytes(BoxSOA, 3*BoxBytesP);
+
+	const BoxPruningKernel Kernel = SelectBoxPruningKernel();
+
+	{
+		// Our pair output buffer
+		PairOutputBuffer POB(pairs);
+
+		for(udword z=0;z<nb_regions_z;z++)
+		for(udword y=0;y<nb_regions_y;y++)
+		{
+			const udword Region = z*nb_regions_y+y;
+			const udword NbInRegion = Offsets[Region+1] - Offsets[Region];
+			if(NbInRegion<2)
+				continue;
+
+			// 4) Prune the region
+			udword* Remap = RegionBoxes + Offsets[Region];
+			BuildBoxSOA(BoxBase, BoxBytesP, NbInRegion, GetPaddedSize(NbInRegion), list, Remap);
+
+			const size_t FirstPair = POB.mEnd - POB.mBegin;	// Not a pointer, the kernel can reallocate
+			Kernel(POB, BoxBase, BoxBase + NbInRegion, Remap, BoxBytesP);
+
+			// 5) Only keep the pairs owned by this region. Overlapping boxes have overlapping region ranges,
+			// so the owner region is touched by both boxes and exactly one region keeps the pair.
+			const udword* Src = POB.mBegin + FirstPair;
+			udword* Dst = POB.mBegin + FirstPair;
+			while(Src!=POB.mEnd)
+			{
+				const RegionBounds& RB0 = Bounds[Src[0]];
+				const RegionBounds& RB1 = Bounds[Src[1]];
+				if(TMax(RB0.mMinY, RB1.mMinY)==y && TMax(RB0.mMinZ, RB1.mMinZ)==z)
+				{
+					Dst[0] = Src[0];
+					Dst[1] = Src[1];
+					Dst += 2;
+				}
+				Src += 2;
+			}
+			POB.mEnd = Dst;
+		}
+	}
+
+	_aligned_free(BoxSOA);
+	DELETEARRAY(RegionBoxes);
+	DELETEARRAY(Bounds);
+	DELETEARRAY(Offsets);
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+ *	Bucketed box pruning. Sweeps along X within coarse slabs along Y. Boxes spanning several slabs are duplicated, and each slab is swept
+ *	independently with the regular kernel. This is the Multi-SAP with a single region along Z, which is cheaper than a full grid and works
+ *	well for elongated scenes (roads, corridors) where a single sweep produces long candidate windows.
+ *
+ *	When nb_slabs is 0 the number of slabs is chosen automatically, so that slabs are about 4 times the average box height.
+ *
+ *	\param		nb			[in] number of boxes
+ *	\param		list		[in] list of boxes
+ *	\param		pairs		[out] list of overlapping pairs
+ *	\param		nb_slabs	[in] number of slabs along Y, or 0 for automatic
+ *	\return		true if success.
+ */
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+bool Meshmerizer::SlabBoxPruning(udword nb, const AABB* list, Container& pairs, udword nb_slabs)
+{
+	// Checkings
+	if(!nb || !list)
+		return false;
+
+	if(!nb_slabs)
+	{
+		// Slabs about 4 times the average box height keep the number of duplicated boxes low. We also keep
+		// at least 32 boxes per slab on average, below that the per-slab overhead dominates.
+		const udword kMaxNbSlabs = 256;
+		float MinY = list[0].mMin.y, MaxY = list[0].mMax.y;
+		float SumExtents = 0.0f;
+		for(udword i=0;i<nb;i++)
+		{
+			MinY = TMin(MinY, list[i].mMin.y);
+			MaxY = TMax(MaxY, list[i].mMax.y);
+			SumExtents += list[i].mMax.y - list[i].mMin.y;
+		}
+		const float AvgExtent = SumExtents / float(nb);
+		const float NbSlabs = AvgExtent>0.0f ? (MaxY - MinY) / (4.0f * AvgExtent) : float(kMaxNbSlabs);
+		nb_slabs = NbSlabs<1.0f ? 1 : NbSlabs>float(kMaxNbSlabs) ? kMaxNbSlabs : udword(NbSlabs);
+		nb_slabs = TMax<udword>(1, TMin<udword>(nb_slabs, nb/32));
+	}
+
+	return MultiSAPBoxPruning(nb, list, pairs, nb_slabs, 1);
+}
+
+// Time-of-overlap refinement for 4 pairs at once, one pair per lane. Boxes move linearly from their start to their end
+// position over t=[0;1], and on each axis each of the two separating conditions is linear in t, i.e. c + t*d >= 0 for
+// overlap. We intersect the resulting time intervals over all axes, and return a mask of the pairs for which it isn't empty.
+static udword SweptOverlap4(const AABB* start, const AABB* end, const udword* pairs)
+{
+	const __m128 Zero = _mm_setzero_ps();
+	const __m128 One = _mm_set1_ps(1.0f);
+	__m128 TFirst = Zero;	// Start of the overlap interval
+	__m128 TLast = One;	// End of the overlap interval
+	__m128 Never = Zero;	// Static separation, i.e. d==0 and c<0
+
+	const AABB& S00 = start[pairs[0]];	const AABB& E00 = end[pairs[0]];	const AABB& S01 = start[pairs[1]];	const AABB& E01 = end[pairs[1]];
+	const AABB& S10 = start[pairs[2]];	const AABB& E10 = end[pairs[2]];	const AABB& S11 = start[pairs[3]];	const AABB& E11 = end[pairs[3]];
+	const AABB& S20 = start[pairs[4]];	const AABB& E20 = end[pairs[4]];	const AABB& S21 = start[pairs[5]];	const AABB& E21 = end[pairs[5]];
+	const AABB& S30 = start[pairs[6]];	const AABB& E30 = end[pairs[6]];	const AABB& S31 = start[pairs[7]];	const AABB& E31 = end[pairs[7]];
+
+	for(udword Axis=0;Axis<3;Axis++)
+	{
+		// Start positions and displacements of both boxes, for the 4 pairs
+		const __m128 Min0 = _mm_setr_ps(S00.GetMin(Axis), S10.GetMin(Axis), S20.GetMin(Axis), S30.GetMin(Axis));
+		const __m128 Max0 = _mm_setr_ps(S00.GetMax(Axis), S10.GetMax(Axis), S20.GetMax(Axis), S30.GetMax(Axis));
+		const __m128 Min1 = _mm_setr_ps(S01.GetMin(Axis), S11.GetMin(Axis), S21.GetMin(Axis), S31.GetMin(Axis));
+		const __m128 Max1 = _mm_setr_ps(S01.GetMax(Axis), S11.GetMax(Axis), S21.GetMax(Axis), S31.GetMax(Axis));
+		const __m128 DMin0 = _mm_sub_ps(_mm_setr_ps(E00.GetMin(Axis), E10.GetMin(Axis), E20.GetMin(Axis), E30.GetMin(Axis)), Min0);
+		const __m128 DMax0 = _mm_sub_ps(_mm_setr_ps(E00.GetMax(Axis), E10.GetMax(Axis), E20.GetMax(Axis), E30.GetMax(Axis)), Max0);
+		const __m128 DMin1 = _mm_sub_ps(_mm_setr_ps(E01.GetMin(Axis), E11.GetMin(Axis), E21.GetMin(Axis), E31.GetMin(Axis)), Min1);
+		const __m128 DMax1 = _mm_sub_ps(_mm_setr_ps(E01.GetMax(Axis), E11.GetMax(Axis), E21.GetMax(Axis), E31.GetMax(Axis)), Max1);
+
+		// Max1(t) >= Min0(t) and Max0(t) >= Min1(t)
+		const __m128 C[2] = { _mm_sub_ps(Max1, Min0), _mm_sub_ps(Max0, Min1) };
+		const __m128 D[2] = { _mm_sub_ps(DMax1, DMin0), _mm_sub_ps(DMax0, DMin1) };
+		for(udword j=0;j<2;j++)
+		{
+			// Masked out where d==0, so the division by zero doesn't matter
+			const __m128 T = _mm_div_ps(_mm_sub_ps(Zero, C[j]), D[j]);
+			const __m128 Pos = _mm_cmpgt_ps(D[j], Zero);
+			const __m128 Neg = _mm_cmplt_ps(D[j], Zero);
+			TFirst = _mm_max_ps(TFirst, _mm_or_ps(_mm_and_ps(Pos, T), _mm_andnot_ps(Pos, TFirst)));
+			TLast = _mm_min_ps(TLast, _mm_or_ps(_mm_and_ps(Neg, T), _mm_andnot_ps(Neg, TLast)));
+			Never = _mm_or_ps(Never, _mm_andnot_ps(_mm_or_ps(Pos, Neg), _mm_cmplt_ps(C[j], Zero)));
+		}
+	}
+	return _mm_movemask_ps(_mm_andnot_ps(Never, _mm_cmple_ps(TFirst, TLast)));
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+ *	Swept box pruning, for continuous collision detection. Each object is given by its start and end boxes, and the pruning runs
+ *	on the swept boxes, i.e. the union of both. The union is computed on-the-fly while building the SoA array, and the regular
+ *	kernel is used. The pairs are conservative: they include all pairs of objects that might collide during the motion.
+ *
+ *	If refine is true, the pairs are then filtered assuming the boxes move linearly from their start to their end position, and
+ *	pairs whose boxes never overlap at the same time are removed. This catches pairs of objects crossing each other's paths at
+ *	different times.
+ *
+ *	\param		nb		[in] number of boxes
+ *	\param		start	[in] list of start boxes
+ *	\param		end		[in] list of end boxes
+ *	\param		pairs	[out] list of overlapping pairs
+ *	\param		refine	[in] true to reject pairs whose boxes are never overlapping at the same time
+ *	\return		true if success.
+ */
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+bool Meshmerizer::SweptBoxPruning(udword nb, const AABB* start, const AABB* end, Container& pairs, bool refine)
+{
+	// Checkings
+	if(!nb || !start || !end)
+		return false;
+
+	udword nbpad = GetPaddedSize(nb);
+	ptrdiff_t BoxBytesP = nbpad*sizeof(FloatOrInt32);
+
+	// Our pair output buffer
+	PairOutputBuffer POB(pairs);
+	const size_t FirstPair = POB.mEnd - POB.mBegin;
+
+	FloatOrInt32* BoxSOA = (FloatOrInt32*)_aligned_malloc(BoxBytesP * 6, 32);
+	FloatOrInt32* BoxBase = PtrAddBytes(BoxSOA, 3*BoxBytesP);
+	FloatOrInt32* BoxEnd = BoxBase + nb;
+
+	udword* Remap;
+	{
+		// Sort the swept boxes along the primary axis. The keys are written to the first SoA array, which is
+		// overwritten by BuildBoxSOA once the ranks are known, so no temporary list is needed.
+		float* Keys = &BoxSOA[0].f;
+		for(udword i=0;i<nb;i++)
+			Keys[i] = TMin(start[i].mMin.x, end[i].mMin.x);
+
+		static PRUNING_SORTER RS;	// Static for coherence
+		RS.SetMode(RADIX_AUTO);
+		Remap = RS.Sort(Keys, nb, sizeof(float)).GetRanks();
+
+		// Prepare the SoA array with the union of the start and end boxes
+		BuildBoxSOA(BoxBase, BoxBytesP, nb, nbpad, start, Remap, end);
+	}
+
+	SelectBoxPruningKernel()(POB, BoxBase, BoxEnd, Remap, BoxBytesP);
+
+	_aligned_free(BoxSOA);
+
+	if(refine)
+	{
+		// Filter and compact the pairs in place, 4 at a time. The last incomplete batch is padded with the last pair.
+		const udword* Src = POB.mBegin + FirstPair;
+		udword* Dst = POB.mBegin + FirstPair;
+		while(Src!=POB.mEnd)
+		{
+			const udword NbLeft = udword(POB.mEnd - Src)/2;
+			udword Batch[8];
+			const udword* Pairs = Src;
+			if(NbLeft<4)
+			{
+				for(udword j=0;j<4;j++)
+				{
+					const udword k = TMin(j, NbLeft-1);
+					Batch[j*2+0] = Src[k*2+0];
+					Batch[j*2+1] = Src[k*2+1];
+				}
+				Pairs = Batch;
+			}
+
+			const udword Mask = SweptOverlap4(start, end, Pairs);
+			const udword NbInBatch = TMin<udword>(NbLeft, 4);
+			for(udword j=0;j<NbInBatch;j++)
+			{
+				if(Mask & (1<<j))
+				{
+					Dst[0] = Pairs[j*2+0];
+					Dst[1] = Pairs[j*2+1];
+					Dst += 2;
+				}
+			}
+			Src += NbInBatch*2;
+		}
+		POB.mEnd = Dst;
+	}
+	return true;
+}
+
+// Used by the k-partite version. The sorter is passed by the caller, like CompleteBoxPruning's.
+template<class SorterT>
+static void KPartitePruning(PairOutputBuffer& POB, SorterT& RS, udword nb, const AABB* list, const udword* set_ids)
+{
+	udword nbpad = GetPaddedSize(nb);
+	ptrdiff_t BoxBytesP = nbpad*sizeof(FloatOrInt32);
+
+	// BoxSOA: in order, arrays for MaxX,MinX (int), MaxY,MinY,MaxZ,MinZ (float), set ids (int).
+	FloatOrInt32* BoxSOA = (FloatOrInt32*)_aligned_malloc(BoxBytesP * 7, 32);
+	FloatOrInt32* BoxBase = PtrAddBytes(BoxSOA, 3*BoxBytesP);
+	FloatOrInt32* BoxEnd = BoxBase + nb;
+	FloatOrInt32* SetIds = PtrAddBytes(BoxBase, 3*BoxBytesP);
+
+	// The sorter reads the boxes directly, no need for a temporary list
+	udword* Remap = RS.Sort(&list[0].mMin.x, nb, sizeof(AABB)).GetRanks();
+
+	BuildBoxSOA(BoxBase, BoxBytesP, nb, nbpad, list, Remap);
+
+	// Padding boxes never overlap anything, their set ids don't matter
+	for(udword i=0;i<nb;i++)
+		SetIds[i].s = set_ids[Remap[i]];
+	for(udword i=nb;i<nbpad;i++)
+		SetIds[i].s = 0;
+
+	BoxPruningKernelKPartite(POB, BoxBase, BoxEnd, Remap, BoxBytesP);
+
+	_aligned_free(BoxSOA);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+ *	K-partite box pruning. Each box belongs to a set, given by a user-defined id, and only pairs of boxes from different sets are
+ *	reported. This is a single sweep over all the boxes, as opposed to one BipartiteBoxPruning call per pair of sets. The set ids
+ *	are stored in the SoA array next to the bounds, and same-set pairs are rejected in the kernel with a SIMD compare.
+ *	\param		nb		[in] number of boxes
+ *	\param		list	[in] list of boxes
+ *	\param		set_ids	[in] set id of each box
+ *	\param		pairs	[out] list of overlapping pairs
+ *	\return		true if success.
+ */
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+bool Meshmerizer::KPartiteBoxPruning(udword nb, const AABB* list, const udword* set_ids, Container& pairs)
+{
+	// Checkings
+	if(!nb || !list || !set_ids)
+		return false;
+
+	// Our pair output buffer
+	PairOutputBuffer POB(pairs);
+
+	static PRUNING_SORTER RS;	// Static for coherence
+	RS.SetMode(RADIX_AUTO);
+	KPartitePruning(POB, RS, nb, list, set_ids);
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+ *	Bipartite box pruning. Returns a list of overlapping pairs of boxes, each box of the pair belongs to a different set.
+ *	Both sets are sorted separately and their orders are merged, and a single sweep over the merged order reports each cross-set
+ *	overlap once, using set tags to reject pairs from the same set. Boxes are gathered straight from both lists, there's no merged copy.
+ *	\param		nb0		[in] number of boxes in the first set
+ *	\param		list0	[in] list of boxes for the first set
+ *	\param		nb1		[in] number of boxes in the second set
+ *	\param		list1	[in] list of boxes for the second set
+ *	\param		pairs	[out] list of overlapping pairs, as (index in list0, index in list1)
+ *	\return		true if success.
+ */
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+bool Meshmerizer::BipartiteBoxPruning(udword nb0, const AABB* list0, udword nb1, const AABB* list1, Container& pairs)
+{
+	// Checkings
+	if(!nb0 || !list0 || !nb1 || !list1)
+		return false;
+
+	const udword nb = nb0 + nb1;
+	udword nbpad = GetPaddedSize(nb);
+	ptrdiff_t BoxBytesP = nbpad*sizeof(FloatOrInt32);
+
+	// BoxSOA: in order, arrays for MaxX,MinX (int), MaxY,MinY,MaxZ,MinZ (float), set tags (int).
+	FloatOrInt32* BoxSOA = (FloatOrInt32*)_aligned_malloc(BoxBytesP * 7, 32);
+	FloatOrInt32* BoxBase = PtrAddBytes(BoxSOA, 3*BoxBytesP);
+	FloatOrInt32* BoxEnd = BoxBase + nb;
+
+	// Sort both lists in place, then merge the sorted orders. Merged indices are below nb0 for list0, nb0 and above for list1.
+	// The kernel reads the remap table 4 entries at a time, so it needs the same slack as the sorter's ranks.
+	udword* Remap = new udword[nb+RADIX_RANKS_SLACK];
+	ZeroMemory(Remap + nb, RADIX_RANKS_SLACK*sizeof(udword));
+	{
+		static PRUNING_SORTER RS0;	// Static for coherence
+		RS0.SetMode(RADIX_AUTO);
+		static PRUNING_SORTER RS1;	// Static for coherence
+		RS1.SetMode(RADIX_AUTO);
+		const udword* Sorted0 = RS0.Sort(&list0[0].mMin.x, nb0, sizeof(AABB)).GetRanks();
+		const udword* Sorted1 = RS1.Sort(&list1[0].mMin.x, nb1, sizeof(AABB)).GetRanks();
+
+		udword i=0, j=0, k=0;
+		while(i<nb0 && j<nb1)
+		{
+			if(list1[Sorted1[j]].mMin.x < list0[Sorted0[i]].mMin.x)
+				Remap[k++] = nb0 + Sorted1[j++];
+			else
+				Remap[k++] = Sorted0[i++];
+		}
+		while(i<nb0)
+			Remap[k++] = Sorted0[i++];
+		while(j<nb1)
+			Remap[k++] = nb0 + Sorted1[j++];
+	}
+
+	// Gather the boxes straight from both lists
+	BuildBoxSOABipartite(BoxBase, BoxBytesP, nb, nbpad, nb0, list0, list1, Remap);
+
+	{
+		// Our pair output buffer
+		PairOutputBuffer POB(pairs);
+		const size_t FirstPair = POB.mEnd - POB.mBegin;
+
+		BoxPruningKernelKPartite(POB, BoxBase, BoxEnd, Remap, BoxBytesP);
+
+		// Convert merged indices back to (index in list0, index in list1)
+		for(udword* Pair = POB.mBegin + FirstPair; Pair!=POB.mEnd; Pair+=2)
+		{
+			if(Pair[0]>=nb0)
+				TSwap(Pair[0], Pair[1]);
+			Pair[1] -= nb0;
+		}
+	}
+
+	_aligned_free(BoxSOA);
+	DELETEARRAY(Remap);
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+ *	Complete box pruning, for boxes given as separate arrays of bounds (e.g. memory-mapped box files). Same results as CompleteBoxPruning.
+ *	\param		nb		[in] number of boxes
+ *	\param		min_x	[in] min x of each box
+ *	\param		min_y	[in] min y of each box
+ *	\param		min_z	[in] min z of each box
+ *	\param		max_x	[in] max x of each box
+ *	\param		max_y	[in] max y of each box
+ *	\param		max_z	[in] max z of each box
+ *	\param		pairs	[out] list of overlapping pairs
+ *	\return		true if success.
+ */
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+bool Meshmerizer::CompleteBoxPruningSoA(udword nb, const float* min_x, const float* min_y, const float* min_z, const float* max_x, const float* max_y, const float* max_z, Container& pairs)
+{
+	// Checkings
+	if(!nb || !min_x || !min_y || !min_z || !max_x || !max_y || !max_z)
+		return false;
+
+	udword nbpad = GetPaddedSize(nb);
+	ptrdiff_t BoxBytesP = nbpad*sizeof(FloatOrInt32);
+
+	// Our pair output buffer
+	PairOutputBuffer POB(pairs);
+
+	FloatOrInt32* BoxSOA = (FloatOrInt32*)_aligned_malloc(BoxBytesP * 6, 32);
+	FloatOrInt32* BoxBase = PtrAddBytes(BoxSOA, 3*BoxBytesP);
+	FloatOrInt32* BoxEnd = BoxBase + nb;
+
+	// The keys are sorted in place, the array can be a read-only file mapping
+	static PRUNING_SORTER RS;	// Static for coherence
+	RS.SetMode(RADIX_AUTO);
+	udword* Remap = RS.Sort(min_x, nb, sizeof(float)).GetRanks();
+
+	BuildBoxSOAFromArrays(BoxBase, BoxBytesP, nb, nbpad, min_x, min_y, min_z, max_x, max_y, max_z, Remap);
+
+	SelectBoxPruningKernel()(POB, BoxBase, BoxEnd, Remap, BoxBytesP);
+
+	_aligned_free(BoxSOA);
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+ *	Complete box pruning with streamed output. Instead of accumulating all the pairs in memory, pairs are collected in a fixed-size
+ *	page which is passed to the user callback each time it fills up, and once more at the end for the remaining pairs. Memory usage
+ *	for the pairs is bounded by the page size, which makes this suitable for offline jobs producing huge numbers of pairs. Use
+ *	FlushPairsToFile as the callback to write the pairs to a file. If the callback returns false, it isn't called anymore and the
+ *	remaining pairs are discarded.
+ *	\param		nb			[in] number of boxes
+ *	\param		list		[in] list of boxes
+ *	\param		callback	[in] called with each full page of pairs
+ *	\param		user_data	[in] user-defined data passed to the callback
+ *	\param		page_size	[in] number of pairs per page, below 2^31 - 8. All pages but the last one have exactly this size.
+ *	\return		true if success, false if the callback failed or the page size is invalid.
+ */
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+bool Meshmerizer::CompleteBoxPruningStreamed(udword nb, const AABB* list, PairFlushCallback callback, void* user_data, udword page_size)
+{
+	// Checkings. The page size in udwords, slack included, must fit in a udword.
+	if(!nb || !list || !callback || !page_size || page_size>(0xffffffff - PairOutputBuffer::kSlack)/2)
+		return false;
+
+	// The page is a regular container, the output buffer never grows it and flushes it instead
+	Container Page;
+	Page.SetSize(page_size*2 + PairOutputBuffer::kSlack);
+	{
+		PairOutputBuffer POB(Page);
+		POB.mFlush = callback;
+		POB.mUserData = user_data;
+
+		static PRUNING_SORTER RS;	// Static for coherence
+		RS.SetMode(RADIX_AUTO);
+		CompleteBoxPruning(POB, RS, nb, list, 0.0f, true);
+
+		FlushPairOutputBuffer(POB, true);
+		return !POB.mFlushFailed;
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+ *	Pair flush callback writing the pairs to a file, as raw pairs of udwords.
+ *	\param		pairs		[in] pairs to write
+ *	\param		nb_pairs	[in] number of pairs
+ *	\param		user_data	[in] the FILE* to write to
+ *	\return		true if success, false if the pairs couldn't be written.
+ */
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+bool Meshmerizer::FlushPairsToFile(const udword* pairs, udword nb_pairs, void* user_data)
+{
+	if(!nb_pairs)
+		return true;
+	return fwrite(pairs, sizeof(udword)*2*nb_pairs, 1, (FILE*)user_data)==1;
+}
+
+// Number of boxes processed between two checks of the time budget and cancel flag
+static const udword kInterruptCheckPeriod = 64;
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+ *	Constructor.
+ */
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+ResumableBoxPruning::ResumableBoxPruning() :
+	mBoxSOA(null), mRemap(null), mNbBoxes(0), mMaxNbBoxes(0), mBox0(0), mRunning(0), mBox1(0), mInInner(false), mDone(true), mBudget(0), mCancel(null)
+{
+	mSorter.SetMode(RADIX_AUTO);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+ *	Destructor.
+ */
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+ResumableBoxPruning::~ResumableBoxPruning()
+{
+	if(mBoxSOA)
+		_aligned_free(mBoxSOA);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+ *	Sets up the boxes for a new query: sorts them, and builds the SoA array. Memory is only allocated when the number of boxes
+ *	grows, so calling this every frame with a constant number of boxes doesn't allocate.
+ *	\param		nb		[in] number of boxes
+ *	\param		list	[in] list of boxes
+ *	\return		true if success.
+ */
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+bool ResumableBoxPruning::Init(udword nb, const AABB* list)
+{
+	mDone = true;
+
+	// Checkings
+	if(!nb || !list)
+		return false;
+
+	const udword nbpad = GetPaddedSize(nb);
+	if(nbpad>mMaxNbBoxes)
+	{
+		if(mBoxSOA)
+			_aligned_free(mBoxSOA);
+		mMaxNbBoxes = nbpad;
+		mBoxSOA = (float*)_aligned_malloc(nbpad*sizeof(FloatOrInt32)*6, 32);
+	}
+	mNbBoxes = nb;
+
+	mRemap = mSorter.Sort(&list[0].mMin.x, nb, sizeof(AABB)).GetRanks();
+
+	// Arrays are always mMaxNbBoxes entries apart, so that we don't need to reallocate when the number of boxes shrinks
+	const ptrdiff_t BoxBytesP = mMaxNbBoxes*sizeof(FloatOrInt32);
+	BuildBoxSOA(PtrAddBytes((FloatOrInt32*)mBoxSOA, 3*BoxBytesP), BoxBytesP, nb, nbpad, list, mRemap);
+
+	Restart();
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+ *	Rewinds the query, so that the next Run() call starts reporting the pairs from the beginning again.
+ */
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+void ResumableBoxPruning::Restart()
+{
+	mBox0 = 0;
+	mRunning = 0;
+	mBox1 = 0;
+	mInInner = false;
+	mDone = !mNbBoxes;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+ *	Reports overlapping pairs to a fixed-size buffer. When the buffer is full the call returns, and the next call resumes exactly
+ *	where this one stopped. No memory is allocated. Pairs are reported 4 candidates at a time, so the buffer must have room for
+ *	at least 4 pairs. The budget and the cancel flag are checked every kInterruptCheckPeriod boxes, so the call can overshoot
+ *	the budget by the time it takes to process that many boxes. The pairs written before an interruption are valid.
+ *	\param		pairs			[out] pair buffer, receives pairs of box indices
+ *	\param		max_nb_pairs	[in] capacity of the pair buffer, in pairs (at least 4)
+ *	\param		nb_pairs		[out] number of pairs written to the buffer
+ *	\return		RESUME_DONE when all the pairs have been reported, else the reason why we stopped.
+ */
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+ResumeStatus ResumableBoxPruning::Run(udword* pairs, udword max_nb_pairs, udword& nb_pairs)
+{
+	nb_pairs = 0;
+	if(mDone)
+		return RESUME_DONE;
+
+	// Checkings
+	if(!pairs || max_nb_pairs<4)
+		return RESUME_INVALID;
+
+	// Interruption state. The checks are done in the outer loop only, for the first box and then every kInterruptCheckPeriod boxes.
+	const uqword StartTime = mBudget ? __rdtsc() : 0;
+	const bool CheckInterrupts = mBudget || mCancel;
+	udword NbToCheck = 1;
+	ResumeStatus Status = RESUME_BUFFER_FULL;
+
+	const ptrdiff_t BoxBytesP = mMaxNbBoxes*sizeof(FloatOrInt32);
+	const ptrdiff_t BoxBytesN = -BoxBytesP;
+	FloatOrInt32* BoxBase = PtrAddBytes((FloatOrInt32*)mBoxSOA, 3*BoxBytesP);
+	const udword* Remap = mRemap;
+	const udword nb = mNbBoxes;
+
+	// Pairs are written 4 at a time, so we stop when less than 4 slots are left
+	udword* Pairs = pairs;
+	const udword* PairsLimit = pairs + (max_nb_pairs-4)*2;
+
+	// This is BoxPruningKernelIntrinsics, with indices instead of pointers so that we can save and restore the state
+	udword Box0 = mBox0;
+	udword Running = mRunning;
+	udword Box1 = mBox1;
+	bool InInner = mInInner;
+	while(Box0<nb)
+	{
+		const FloatOrInt32* Box0Ptr = BoxBase + Box0;
+		if(!InInner)
+		{
+			if(CheckInterrupts && !--NbToCheck)
+			{
+				NbToCheck = kInterruptCheckPeriod;
+				if(mCancel && *mCancel)
+				{
+					Status = RESUME_CANCELLED;
+					goto _Stop;
+				}
+				if(mBudget && __rdtsc() - StartTime > mBudget)
+				{
+					Status = RESUME_OUT_OF_BUDGET;
+					goto _Stop;
+				}
+			}
+
+			const sdword MinLimit = PtrAddBytes(Box0Ptr, 2*BoxBytesN)->s;
+			while (PtrAddBytes(BoxBase + Running++, 2*BoxBytesN)->s < MinLimit);
+			if (Running >= nb)
+				break;
+			Box1 = Running;
+			InInner = true;
+		}
+
+		const sdword MaxLimit = PtrAddBytes(Box0Ptr, 3*BoxBytesN)->s;
+		__m128i MaxLimitVec = _mm_set1_epi32(MaxLimit);
+		__m128 Box0MaxY = _mm_set1_ps(PtrAddBytes(Box0Ptr, 1*BoxBytesN)->f);
+		__m128 Box0MinY = _mm_set1_ps(PtrAddBytes(Box0Ptr, 0*BoxBytesP)->f);
+		__m128 Box0MaxZ = _mm_set1_ps(PtrAddBytes(Box0Ptr, 1*BoxBytesP)->f);
+		__m128 Box0MinZ = _mm_set1_ps(PtrAddBytes(Box0Ptr, 2*BoxBytesP)->f);
+
+		// Main loop
+		while (PtrAddBytes(BoxBase + Box1 + 3, 2*BoxBytesN)->s <= MaxLimit)
+		{
+			if(Pairs>PairsLimit)
+				goto _Stop;
+
+			const FloatOrInt32* Box1Ptr = BoxBase + Box1;
+			__m128 Box1MaxY = _mm_loadu_ps(&PtrAddBytes(Box1Ptr, 1*BoxBytesN)->f);
+			__m128 Box1MinY = _mm_loadu_ps(&PtrAddBytes(Box1Ptr, 0*BoxBytesP)->f);
+			__m128 Box1MaxZ = _mm_loadu_ps(&PtrAddBytes(Box1Ptr, 1*BoxBytesP)->f);
+			__m128 Box1MinZ = _mm_loadu_ps(&PtrAddBytes(Box1Ptr, 2*BoxBytesP)->f);
+
+			__m128 Cmp;
+			Cmp = _mm_cmpnlt_ps(Box1MaxY, Box0MinY);
+			Cmp = _mm_and_ps(Cmp, _mm_cmple_ps(Box1MinY, Box0MaxY));
+			Cmp = _mm_and_ps(Cmp, _mm_cmpnlt_ps(Box1MaxZ, Box0MinZ));
+			Cmp = _mm_and_ps(Cmp, _mm_cmple_ps(Box1MinZ, Box0MaxZ));
+
+			int Mask = _mm_movemask_ps(Cmp);
+			if (Mask)
+				Pairs = StoreUpTo4Intersections(Pairs, Remap[Box0], Remap + Box1, Mask);
+			Box1 += 4;
+		}
+
+		// Tail group
+		if (PtrAddBytes(BoxBase + Box1, 2*BoxBytesN)->s <= MaxLimit)
+		{
+			if(Pairs>PairsLimit)
+				goto _Stop;
+
+			const FloatOrInt32* Box1Ptr = BoxBase + Box1;
+			__m128i Box1MinX = _mm_loadu_si128((const __m128i *)&PtrAddBytes(Box1Ptr, 2*BoxBytesN)->s);
+			__m128 OutsideMask = _mm_castsi128_ps(_mm_cmpgt_epi32(Box1MinX, MaxLimitVec));
+
+			__m128 Box1MaxY = _mm_loadu_ps(&PtrAddBytes(Box1Ptr, 1*BoxBytesN)->f);
+			__m128 Box1MinY = _mm_loadu_ps(&PtrAddBytes(Box1Ptr, 0*BoxBytesP)->f);
+			__m128 Box1MaxZ = _mm_loadu_ps(&PtrAddBytes(Box1Ptr, 1*BoxBytesP)->f);
+			__m128 Box1MinZ = _mm_loadu_ps(&PtrAddBytes(Box1Ptr, 2*BoxBytesP)->f);
+
+			__m128 Cmp;
+			Cmp = _mm_andnot_ps(OutsideMask, _mm_cmpnlt_ps(Box1MaxY, Box0MinY));
+			Cmp = _mm_and_ps(Cmp, _mm_cmple_ps(Box1MinY, Box0MaxY));
+			Cmp = _mm_and_ps(Cmp, _mm_cmpnlt_ps(Box1MaxZ, Box0MinZ));
+			Cmp = _mm_and_ps(Cmp, _mm_cmple_ps(Box1MinZ, Box0MaxZ));
+
+			int Mask = _mm_movemask_ps(Cmp);
+			if (Mask)
+				Pairs = StoreUpTo4Intersections(Pairs, Remap[Box0], Remap + Box1, Mask);
+		}
+		InInner = false;
+		Box0++;
+	}
+	mDone = true;
+	Status = RESUME_DONE;
+
+_Stop:
+	mBox0 = Box0;
+	mRunning = Running;
+	mBox1 = Box1;
+	mInInner = InInner;
+	nb_pairs = udword(Pairs - pairs)/2;
+	return Status;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+ *	Constructor.
+ */
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+BoxPruningTask::BoxPruningTask() : mEvent(null), mList(null), mNbBoxes(0), mPending(false)
+{
+	mSorter.SetMode(RADIX_AUTO);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+ *	Destructor. Waits for the task to complete if it is still running.
+ */
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+BoxPruningTask::~BoxPruningTask()
+{
+	Wait();
+	if(mEvent)
+		CloseHandle(mEvent);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+ *	Starts pruning the boxes on the shared thread pool. The boxes must stay alive and unmodified until Wait() returns.
+ *	\param		nb		[in] number of boxes
+ *	\param		list	[in] list of boxes
+ *	\return		true if the task has been submitted.
+ */
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+bool BoxPruningTask::Submit(udword nb, const AABB* list)
+{
+	// Checkings
+	if(!nb || !list || mPending)
+		return false;
+
+	ThreadPool* Pool = GetBoxPruningThreadPool();
+	if(!Pool)
+		return false;
+
+	if(!mEvent)
+	{
+		mEvent = CreateEventA(null, TRUE, FALSE, null);
+		if(!mEvent)
+			return false;
+	}
+	ResetEvent(mEvent);
+
+	mNbBoxes = nb;
+	mList = list;
+	mPairs.Reset();
+
+	mJob.mFunction = Execute;
+	mJob.mUserData = this;
+	mPending = true;
+	Pool->Submit(mJob);
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+ *	Checks whether the task has completed, without blocking.
+ *	\return		true if the pairs are available.
+ */
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+bool BoxPruningTask::IsDone() const
+{
+	return !mPending || WaitForSingleObject(mEvent, 0)==WAIT_OBJECT_0;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+ *	Waits for the task to complete.
+ *	\return		the list of overlapping pairs.
+ */
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+const Container& BoxPruningTask::Wait()
+{
+	if(mPending)
+	{
+		WaitForSingleObject(mEvent, INFINITE);
+		mPending = false;
+	}
+	return mPairs;
+}
+
+// Runs on a worker thread
+void BoxPruningTask::Execute(void* user_data)
+{
+	BoxPruningTask* Task = (BoxPruningTask*)user_data;
+	{
+		PairOutputBuffer POB(Task->mPairs);
+		CompleteBoxPruning(POB, Task->mSorter, Task->mNbBoxes, Task->mList, 0.0f, false);	// We're already on a pool thread
+	}
+	SetEvent(Task->mEvent);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+ *	Asynchronous complete box pruning. Starts pruning the boxes on the shared thread pool and returns immediately, so that the
+ *	caller can do something else in the meantime. The pairs are then fetched with task.Wait(). Each task has its own sorter,
+ *	so several tasks can run at the same time, and reusing a task from one frame to the next keeps the sorter's coherence.
+ *	\param		nb		[in] number of boxes
+ *	\param		list	[in] list of boxes, must stay alive and unmodified until the task completes
+ *	\param		task	[out] task handle
+ *	\return		true if the task has been submitted.
+ */
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+bool Meshmerizer::SubmitCompleteBoxPruning(udword nb, const AABB* list, BoxPruningTask& task)
+{
+	return task.Submit(nb, list);
+}
+
+// One stage of the pruning pipeline: the sorted SoA boxes of a snapshot
+struct PipelineSlot
+{
+	inline_	PipelineSlot() : mBoxSOA(null), mRemap(null), mNbBoxes(0), mMaxNbBoxes(0), mList(null)	{ mSorter.SetMode(RADIX_AUTO);	}
+	inline_	~PipelineSlot()
+	{
+		if(mBoxSOA)
+			_aligned_free(mBoxSOA);
+	}
+
+	PRUNING_SORTER	mSorter;		// Each slot has its own sorter since both can be busy at the same time
+	FloatOrInt32*	mBoxSOA;
+	const udword*	mRemap;
+	udword			mNbBoxes;
+	udword			mMaxNbBoxes;	// Allocated size, padding included
+	const AABB*		mList;			// Snapshot to prepare
+	ThreadPoolJob	mJob;
+};
+
+// Sort + SoA build of a snapshot. Buffers are only reallocated when the snapshots grow.
+static void PreparePipelineSlot(void* user_data)
+{
+	PipelineSlot* Slot = (PipelineSlot*)user_data;
+	const udword nb = Slot->mNbBoxes;
+	const AABB* list = Slot->mList;
+	if(!nb)
+		return;
+
+	const udword nbpad = GetPaddedSize(nb);
+	if(nbpad>Slot->mMaxNbBoxes)
+	{
+		if(Slot->mBoxSOA)
+			_aligned_free(Slot->mBoxSOA);
+		Slot->mMaxNbBoxes = nbpad;
+		Slot->mBoxSOA = (FloatOrInt32*)_aligned_malloc(nbpad*sizeof(FloatOrInt32)*6, 32);
+	}
+
+	Slot->mRemap = Slot->mSorter.Sort(&list[0].mMin.x, nb, sizeof(AABB)).GetRanks();
+
+	const ptrdiff_t BoxBytesP = Slot->mMaxNbBoxes*sizeof(FloatOrInt32);
+	BuildBoxSOA(PtrAddBytes(Slot->mBoxSOA, 3*BoxBytesP), BoxBytesP, nb, nbpad, list, Slot->mRemap);
+}
+
+// Signals the caller once the slot is ready
+struct PipelineJobData
+{
+	PipelineSlot*	mSlot;
+	void*			mEvent;
+};
+
+static void PreparePipelineSlotAndSignal(void* user_data)
+{
+	PipelineJobData* Data = (PipelineJobData*)user_data;
+	PreparePipelineSlot(Data->mSlot);
+	SetEvent(Data->mEvent);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+ *	Pipelined complete box pruning over a sequence of box snapshots, e.g. a recorded trajectory. The sort and SoA build of the
+ *	next snapshot run on the shared thread pool while the current snapshot is swept on the calling thread, using two sets of
+ *	buffers. For long sequences the cost per snapshot gets close to the slowest of the two stages instead of their sum.
+ *	Pairs are delivered in order, on the calling thread. The pool is only used if ConfigureBoxPruningThreadPool enabled
+ *	parallel_build, and never from inside a pool job, where waiting for the next snapshot could deadlock. Otherwise the snapshots
+ *	are processed serially.
+ *	\param		nb_snapshots	[in] number of snapshots
+ *	\param		nb_boxes		[in] number of boxes of each snapshot
+ *	\param		snapshots		[in] boxes of each snapshot
+ *	\param		callback		[in] called with the pairs of each snapshot, in order
+ *	\param		user_data		[in] user-defined data passed to the callback
+ *	\return		true if success.
+ */
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+bool Meshmerizer::PipelinedBoxPruning(udword nb_snapshots, const udword* nb_boxes, const AABB* const* snapshots, PipelinePairCallback callback, void* user_data)
+{
+	// Checkings
+	if(!nb_snapshots || !nb_boxes || !snapshots || !callback)
+		return false;
+
+	// We wait for our own job below, so this has the same restrictions as the helper pool of the synchronous functions
+	ThreadPool* Pool = GetBoxPruningHelperPool();
+	void* Event = Pool ? CreateEventA(null, FALSE, FALSE, null) : null;
+
+	PipelineSlot Slots[2];
+	PipelineJobData JobData;
+	JobData.mEvent = Event;
+
+	const BoxPruningKernel Kernel = SelectBoxPruningKernel();
+	Container Pairs;
+
+	// Prime the pipeline
+	Slots[0].mNbBoxes = nb_boxes[0];
+	Slots[0].mList = snapshots[0];
+	PreparePipelineSlot(&Slots[0]);
+
+	for(udword i=0;i<nb_snapshots;i++)
+	{
+		PipelineSlot& Current = Slots[i&1];
+
+		// Start preparing the next snapshot
+		const bool HasNext = i+1<nb_snapshots;
+		if(HasNext)
+		{
+			PipelineSlot& Next = Slots[(i+1)&1];
+			Next.mNbBoxes = nb_boxes[i+1];
+			Next.mList = snapshots[i+1];
+			if(Event)
+			{
+				JobData.mSlot = &Next;
+				Next.mJob.mFunction = PreparePipelineSlotAndSignal;
+				Next.mJob.mUserData = &JobData;
+				Pool->Submit(Next.mJob);
+			}
+		}
+
+		// Sweep the current one meanwhile
+		Pairs.Reset();
+		if(Current.mNbBoxes)
+		{
+			PairOutputBuffer POB(Pairs);
+			const ptrdiff_t BoxBytesP = Current.mMaxNbBoxes*sizeof(FloatOrInt32);
+			FloatOrInt32* BoxBase = PtrAddBytes(Current.mBoxSOA, 3*BoxBytesP);
+			(Kernel)(POB, BoxBase, BoxBase + Current.mNbBoxes, const_cast<udword*>(Current.mRemap), BoxBytesP);
+		}
+		(callback)(i, Pairs, user_data);
+
+		if(HasNext)
+		{
+			if(Event)
+				WaitForSingleObject(Event, INFINITE);
+			else
+				PreparePipelineSlot(&Slots[(i+1)&1]);
+		}
+	}
+
+	if(Event)
+		CloseHandle(Event);
+	return true;
+}
+
+// Buffers of BatchedBoxPruning, kept from one call to the next. They are only reallocated when the batches grow.
+class BatchedPruningBuffers
+{
+	public:
+					BatchedPruningBuffers() : mBoxSOA(null), mRemap(null), mSegmentStarts(null), mMaxNbBoxes(0), mMaxNbScenes(0)	{}
+					~BatchedPruningBuffers()
+					{
+						DELETEARRAY(mSegmentStarts);
+						DELETEARRAY(mRemap);
+						if(mBoxSOA)
+							_aligned_free(mBoxSOA);
+					}
+
+	void			Reserve(udword nbpad, udword nb_scenes)
+	{
+		if(nbpad>mMaxNbBoxes)
+		{
+			DELETEARRAY(mRemap);
+			if(mBoxSOA)
+				_aligned_free(mBoxSOA);
+			mMaxNbBoxes = nbpad;
+			mBoxSOA = (FloatOrInt32*)_aligned_malloc(nbpad*sizeof(FloatOrInt32)*6, 32);
+			mRemap = new udword[nbpad];
+		}
+		if(nb_scenes+1>mMaxNbScenes)
+		{
+			DELETEARRAY(mSegmentStarts);
+			mMaxNbScenes = nb_scenes+1;
+			mSegmentStarts = new udword[nb_scenes+1];
+		}
+	}
+
+	FloatOrInt32*	mBoxSOA;
+	udword*			mRemap;
+	udword*			mSegmentStarts;
+	udword			mMaxNbBoxes;	// Allocated size, padding included
+	udword			mMaxNbScenes;	// Allocated size, plus one for the end of the last segment
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+ *	Batched complete box pruning, for many small independent scenes. Scene i uses boxes scene_offsets[i] to scene_offsets[i+1]-1
+ *	of the list, and boxes from different scenes never overlap. All scenes are sorted at once (by MinX, then by scene id), and
+ *	stored in a single SoA array where each scene is a padded segment terminated by sentinels, so that the sweep never crosses
+ *	scene boundaries. Setup costs (sort, kernel selection) are paid once for the whole batch, and the buffers are kept from one
+ *	call to the next, so that batches of similar sizes don't allocate at all.
+ *	Pairs of scene i are pairs pair_offsets[i] to pair_offsets[i+1]-1 of the output, and use indices in the whole list.
+ *	\param		nb_scenes		[in] number of scenes
+ *	\param		scene_offsets	[in] first box of each scene, plus the total number of boxes (nb_scenes+1 entries)
+ *	\param		list			[in] list of boxes
+ *	\param		pairs			[out] list of overlapping pairs, grouped by scene
+ *	\param		pair_offsets	[out] first pair of each scene, plus the total number of pairs (nb_scenes+1 entries)
+ *	\return		true if success.
+ */
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+bool Meshmerizer::BatchedBoxPruning(udword nb_scenes, const udword* scene_offsets, const AABB* list, Container& pairs, udword* pair_offsets)
+{
+	// Checkings
+	if(!nb_scenes || !scene_offsets || !list || !pair_offsets)
+		return false;
+
+	const udword nb = scene_offsets[nb_scenes] - scene_offsets[0];
+	if(!nb)
+	{
+		ZeroMemory(pair_offsets, (nb_scenes+1)*sizeof(udword));
+		return true;
+	}
+	list += scene_offsets[0];
+
+	// 1) Segments. Each scene is padded the same way as a single call would, which gives us the sentinels.
+	static BatchedPruningBuffers Buffers;	// Static so that the buffers are reused from one call to the next
+	udword nbpad = 0;
+	for(udword i=0;i<nb_scenes;i++)
+	{
+		const udword NbInScene = scene_offsets[i+1] - scene_offsets[i];
+		nbpad += NbInScene ? GetPaddedSize(NbInScene) : 0;
+	}
+	Buffers.Reserve(nbpad, nb_scenes);
+
+	udword* SegmentStarts = Buffers.mSegmentStarts;
+	SegmentStarts[0] = 0;
+	for(udword i=0;i<nb_scenes;i++)
+	{
+		const udword NbInScene = scene_offsets[i+1] - scene_offsets[i];
+		SegmentStarts[i+1] = SegmentStarts[i] + (NbInScene ? GetPaddedSize(NbInScene) : 0);
+	}
+	const ptrdiff_t BoxBytesP = nbpad*sizeof(FloatOrInt32);
+
+	FloatOrInt32* BoxSOA = Buffers.mBoxSOA;
+	FloatOrInt32* BoxBase = PtrAddBytes(BoxSOA, 3*BoxBytesP);
+
+	// 2) Sort by MinX, then by scene id. The second pass is stable so each scene stays sorted by MinX. The scene ids are
+	// written to the first SoA array, which is overwritten by the SoA build once the ranks are known.
+	const udword* Sorted;
+	{
+		udword* SceneIds = (udword*)BoxSOA;
+		for(udword i=0;i<nb_scenes;i++)
+		{
+			for(udword j=scene_offsets[i];j<scene_offsets[i+1];j++)
+				SceneIds[j - scene_offsets[0]] = i;
+		}
+
+		static PRUNING_SORTER RS;	// Static for coherence
+		RS.SetMode(RADIX_AUTO);
+		Sorted = RS.Sort(&list[0].mMin.x, nb, sizeof(AABB)).Sort(SceneIds, nb, false).GetRanks();
+	}
+
+	// Remap in segment space. Padding entries are read by the kernels but never reported.
+	udword* Remap = Buffers.mRemap;
+	ZeroMemory(Remap, nbpad*sizeof(udword));
+
+	// 3) Build the SoA segments
+	for(udword i=0;i<nb_scenes;i++)
+	{
+		const udword NbInScene = scene_offsets[i+1] - scene_offsets[i];
+		if(!NbInScene)
+			continue;
+		const udword Start = SegmentStarts[i];
+		CopyMemory(Remap + Start, Sorted + scene_offsets[i] - scene_offsets[0], NbInScene*sizeof(udword));
+		BuildBoxSOA(BoxBase + Start, BoxBytesP, NbInScene, SegmentStarts[i+1] - Start, list, Remap + Start);
+
+		// Indices in the whole list
+		for(udword j=0;j<NbInScene;j++)
+			Remap[Start+j] += scene_offsets[0];
+	}
+
+	// 4) Prune each segment. This is one kernel call per scene rather than one sweep over all the segments: the sweep would
+	// have to reset its running pointer and record the pair offsets at each scene boundary anyway, which is all the call does
+	// on top of the sweep itself (a few loads, no allocation).
+	{
+		PairOutputBuffer POB(pairs);
+		const udword FirstPair = udword(POB.mEnd - POB.mBegin)/2;
+
+		const BoxPruningKernel Kernel = SelectBoxPruningKernel();
+		for(udword i=0;i<nb_scenes;i++)
+		{
+			pair_offsets[i] = udword(POB.mEnd - POB.mBegin)/2 - FirstPair;
+
+			const udword NbInScene = scene_offsets[i+1] - scene_offsets[i];
+			if(NbInScene)
+			{
+				FloatOrInt32* SegmentBase = BoxBase + SegmentStarts[i];
+				(Kernel)(POB, SegmentBase, SegmentBase + NbInScene, Remap + SegmentStarts[i], BoxBytesP);
+			}
+		}
+		pair_offsets[nb_scenes] = udword(POB.mEnd - POB.mBegin)/2 - FirstPair;
+	}
+	return true;
+}
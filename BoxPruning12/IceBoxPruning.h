@@ -12,8 +12,118 @@
 #ifndef ICEBOXPRUNING_H
 #define ICEBOXPRUNING_H
 
+	// InsertionSort has better coherence, RadixSort is better for one-shot queries.
+	// AdaptiveSort is in-between: RadixSort plus some overhead for one-shot queries, faster when boxes move a little each frame.
+	#define PRUNING_SORTER	RadixSort
+	//#define PRUNING_SORTER	InsertionSort
+	//#define PRUNING_SORTER	AdaptiveSort
+
+	//! Called by the streamed versions each time the page of pairs is full, and once at the end for the remaining pairs.
+	typedef bool	(*PairFlushCallback)(const udword* pairs, udword nb_pairs, void* user_data);
+	//! Called by the pipelined version with the pairs of each snapshot, in order.
+	typedef void	(*PipelinePairCallback)(udword snapshot_index, const Container& pairs, void* user_data);
+
 	// Optimized versions
 	FUNCTION MESHMERIZER_API bool CompleteBoxPruning(udword nb, const AABB* list, Container& pairs);
+	FUNCTION MESHMERIZER_API bool CompleteBoxPruningWithSorter(udword nb, const AABB* list, Container& pairs, PRUNING_SORTER& sorter);
+	FUNCTION MESHMERIZER_API bool CompleteBoxPruningInflated(udword nb, const AABB* list, Container& pairs, float distance);
+	FUNCTION MESHMERIZER_API bool CompleteBoxPruningStreamed(udword nb, const AABB* list, PairFlushCallback callback, void* user_data, udword page_size);
+	FUNCTION MESHMERIZER_API bool FlushPairsToFile(const udword* pairs, udword nb_pairs, void* user_data);
+	FUNCTION MESHMERIZER_API bool CompleteBoxPruningSoA(udword nb, const float* min_x, const float* min_y, const float* min_z, const float* max_x, const float* max_y, const float* max_z, Container& pairs);
 	FUNCTION MESHMERIZER_API bool BipartiteBoxPruning(udword nb0, const AABB* list0, udword nb1, const AABB* list1, Container& pairs);
+	FUNCTION MESHMERIZER_API bool KPartiteBoxPruning(udword nb, const AABB* list, const udword* set_ids, Container& pairs);
+	FUNCTION MESHMERIZER_API bool BatchedBoxPruning(udword nb_scenes, const udword* scene_offsets, const AABB* list, Container& pairs, udword* pair_offsets);
+
+	// Spatially partitioned versions
+	FUNCTION MESHMERIZER_API bool MultiSAPBoxPruning(udword nb, const AABB* list, Container& pairs, udword nb_regions_y, udword nb_regions_z);
+	FUNCTION MESHMERIZER_API bool SlabBoxPruning(udword nb, const AABB* list, Container& pairs, udword nb_slabs);
+
+	// Continuous collision detection
+	FUNCTION MESHMERIZER_API bool SweptBoxPruning(udword nb, const AABB* start, const AABB* end, Container& pairs, bool refine);
+
+	//! Result of a ResumableBoxPruning::Run() call
+	enum ResumeStatus
+	{
+		RESUME_DONE,			//!< All pairs have been reported
+		RESUME_BUFFER_FULL,		//!< The pair buffer is full, call Run() again to get the next pairs
+		RESUME_OUT_OF_BUDGET,	//!< The time budget has been exceeded, call Run() again to continue
+		RESUME_CANCELLED,		//!< The cancel flag has been set. Clear it (or call SetCancelFlag(null)) before calling Run() again to continue, or Restart() to start over
+		RESUME_INVALID,			//!< Invalid parameters, e.g. a pair buffer smaller than 4 pairs
+
+		RESUME_FORCE_DWORD	= 0x7fffffff
+	};
+
+	// Complete box pruning with a fixed-size pair buffer. Boxes are set up once with Init(), then Run() is called repeatedly, each
+	// call filling the user's buffer and resuming where the previous one stopped, until all pairs have been reported. Run() never
+	// allocates, and Init() only allocates when the number of boxes grows. Run() can also stop early when a time budget is exceeded
+	// or when a cancel flag is set, and resumes the same way.
+	class MESHMERIZER_API ResumableBoxPruning
+	{
+		public:
+		// Constructor/Destructor
+								ResumableBoxPruning();
+								~ResumableBoxPruning();
+
+				bool			Init(udword nb, const AABB* list);
+				void			Restart();
+				ResumeStatus	Run(udword* pairs, udword max_nb_pairs, udword& nb_pairs);
+
+		// Interruption. The budget is in CPU cycles (rdtsc), 0 for none. The cancel flag is polled, set it to non-zero from any thread.
+		// The flag is only read, Run() keeps returning RESUME_CANCELLED until the caller resets it to zero.
+		inline_	void			SetBudget(uqword nb_cycles)					{ mBudget = nb_cycles;	}
+		inline_	uqword			GetBudget()							const	{ return mBudget;		}
+		inline_	void			SetCancelFlag(const volatile long* flag)	{ mCancel = flag;		}
+
+		inline_	bool			IsDone()		const	{ return mDone;		}
+		inline_	udword			GetNbBoxes()	const	{ return mNbBoxes;	}
+
+								PREVENT_COPY(ResumableBoxPruning)
+		private:
+				float*			mBoxSOA;		//!< Same layout as CompleteBoxPruning's, arrays are mMaxNbBoxes entries apart
+				const udword*	mRemap;
+				PRUNING_SORTER	mSorter;		//!< Member for coherence
+				udword			mNbBoxes;
+				udword			mMaxNbBoxes;	//!< Allocated size, padding included
+		// Continuation
+				udword			mBox0;			//!< Current box
+				udword			mRunning;		//!< Running index, i.e. first box whose MinX is not below the current box's
+				udword			mBox1;			//!< Next group of boxes to test against the current box
+				bool			mInInner;		//!< mBox1 is valid, we stopped in the middle of the current box
+				bool			mDone;
+		// Interruption
+				uqword			mBudget;
+				const volatile long*	mCancel;
+	};
+
+	// Handle for an asynchronous complete box pruning, see SubmitCompleteBoxPruning.
+	class MESHMERIZER_API BoxPruningTask
+	{
+		public:
+		// Constructor/Destructor
+								BoxPruningTask();
+								~BoxPruningTask();
+
+				bool			Submit(udword nb, const AABB* list);
+				bool			IsDone()	const;
+				const Container&	Wait();
+
+								PREVENT_COPY(BoxPruningTask)
+		private:
+				Container		mPairs;
+				PRUNING_SORTER	mSorter;		//!< Per-task sorter, the static ones aren't thread-safe
+				ThreadPoolJob	mJob;
+				void*			mEvent;			//!< Signaled when the pairs are available
+				const AABB*		mList;
+				udword			mNbBoxes;
+				bool			mPending;
+
+		static	void			Execute(void* user_data);
+	};
+
+	FUNCTION MESHMERIZER_API bool SubmitCompleteBoxPruning(udword nb, const AABB* list, BoxPruningTask& task);
+
+	// Pipelined version for sequences of snapshots: sorts snapshot N+1 on the thread pool while snapshot N is swept. Serial unless
+	// the pool is enabled for the synchronous functions (see ConfigureBoxPruningThreadPool).
+	FUNCTION MESHMERIZER_API bool PipelinedBoxPruning(udword nb_snapshots, const udword* nb_boxes, const AABB* const* snapshots, PipelinePairCallback callback, void* user_data);
 
 #endif // ICEBOXPRUNING_H
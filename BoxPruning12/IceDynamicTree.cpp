@@ -0,0 +1,614 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+ *	Contains code for the "box pruning revisited" project.
+ *	\file		IceDynamicTree.cpp
+ *	\author		Pierre Terdiman
+ *	\date		February 2017
+ */
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Precompiled Header
+#include "Stdafx.h"
+#include "IcePairOutputBuffer.h"
+#include "IceFatBox.h"
+
+using namespace Meshmerizer;
+
+static inline_ void MergeBoxes(AABB& dst, const AABB& a, const AABB& b)
+{
+	dst.mMin.x = TMin(a.mMin.x, b.mMin.x);
+	dst.mMin.y = TMin(a.mMin.y, b.mMin.y);
+	dst.mMin.z = TMin(a.mMin.z, b.mMin.z);
+	dst.mMax.x = TMax(a.mMax.x, b.mMax.x);
+	dst.mMax.y = TMax(a.mMax.y, b.mMax.y);
+	dst.mMax.z = TMax(a.mMax.z, b.mMax.z);
+}
+
+// Half the surface area, which is all the insertion cost needs
+static inline_ float HalfArea(const AABB& box)
+{
+	const float dx = box.mMax.x - box.mMin.x;
+	const float dy = box.mMax.y - box.mMin.y;
+	const float dz = box.mMax.z - box.mMin.z;
+	return dx*dy + dy*dz + dz*dx;
+}
+
+static inline_ float MergedHalfArea(const AABB& a, const AABB& b)
+{
+	AABB Merged;
+	MergeBoxes(Merged, a, b);
+	return HalfArea(Merged);
+}
+
+// We use a Container as a stack of node indices for the traversals
+static inline_ udword PopEntry(Container& stack)
+{
+	const udword Entry = stack.GetEntry(stack.GetNbEntries()-1);
+	stack.DeleteLastEntry();
+	return Entry;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+ *	Constructor.
+ */
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+DynamicTree::DynamicTree() : mNodes(null), mNbNodes(0), mFreeList(INVALID_ID), mRoot(INVALID_ID), mNbProxies(0), mMargin(0.1f)
+{
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+ *	Destructor.
+ */
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+DynamicTree::~DynamicTree()
+{
+	DELETEARRAY(mNodes);
+}
+
+udword DynamicTree::AllocateNode()
+{
+	// Grow the pool if needed. Nodes are referenced by index so they can move.
+	if(mFreeList==INVALID_ID)
+	{
+		const udword NewNbNodes = mNbNodes ? mNbNodes*2 : 16;
+		DynamicTreeNode* NewNodes = new DynamicTreeNode[NewNbNodes];
+		if(mNbNodes)
+			CopyMemory(NewNodes, mNodes, mNbNodes*sizeof(DynamicTreeNode));
+		DELETEARRAY(mNodes);
+		mNodes = NewNodes;
+
+		for(udword i=mNbNodes;i<NewNbNodes;i++)
+		{
+			mNodes[i].mParent = i+1;
+			mNodes[i].mHeight = -1;
+			mNodes[i].mMoved = false;
+		}
+		mNodes[NewNbNodes-1].mParent = INVALID_ID;
+		mFreeList = mNbNodes;
+		mNbNodes = NewNbNodes;
+	}
+
+	const udword Index = mFreeList;
+	DynamicTreeNode& Node = mNodes[Index];
+	mFreeList = Node.mParent;
+	Node.mParent	= INVALID_ID;
+	Node.mChild0	= INVALID_ID;
+	Node.mChild1	= INVALID_ID;
+	Node.mHeight	= 0;
+	Node.mUserData	= INVALID_ID;
+	Node.mMoved		= false;
+	return Index;
+}
+
+void DynamicTree::FreeNode(udword node)
+{
+	if(mNodes[node].mMoved)
+		mMoved.Delete(node);
+
+	mNodes[node].mParent = mFreeList;
+	mNodes[node].mHeight = -1;
+	mNodes[node].mMoved = false;
+	mFreeList = node;
+}
+
+void DynamicTree::MarkMoved(udword leaf)
+{
+	if(!mNodes[leaf].mMoved)
+	{
+		mNodes[leaf].mMoved = true;
+		mMoved.Add(leaf);
+	}
+}
+
+void DynamicTree::InsertLeaf(udword leaf)
+{
+	if(mRoot==INVALID_ID)
+	{
+		mRoot = leaf;
+		mNodes[leaf].mParent = INVALID_ID;
+		return;
+	}
+
+	// 1) Find the best sibling. Descend while pushing the leaf down is cheaper than making it a sibling of the
+	// current node. The cost of a subtree is the area of its nodes, and every ancestor grows by the leaf's box.
+	const AABB LeafBox = mNodes[leaf].mBox;
+	udword Index = mRoot;
+	while(!mNodes[Index].IsLeaf())
+	{
+		const DynamicTreeNode& Node = mNodes[Index];
+		const udword Child0 = Node.mChild0;
+		const udword Child1 = Node.mChild1;
+
+		const float Area = HalfArea(Node.mBox);
+		const float CombinedArea = MergedHalfArea(Node.mBox, LeafBox);
+
+		// Cost of creating a new parent for this node and the new leaf
+		const float Cost = 2.0f * CombinedArea;
+
+		// Minimum cost of pushing the leaf further down the tree
+		const float InheritanceCost = 2.0f * (CombinedArea - Area);
+
+		const DynamicTreeNode& Node0 = mNodes[Child0];
+		float Cost0 = MergedHalfArea(Node0.mBox, LeafBox) + InheritanceCost;
+		if(!Node0.IsLeaf())
+			Cost0 -= HalfArea(Node0.mBox);
+
+		const DynamicTreeNode& Node1 = mNodes[Child1];
+		float Cost1 = MergedHalfArea(Node1.mBox, LeafBox) + InheritanceCost;
+		if(!Node1.IsLeaf())
+			Cost1 -= HalfArea(Node1.mBox);
+
+		if(Cost<Cost0 && Cost<Cost1)
+			break;
+
+		Index = Cost0<Cost1 ? Child0 : Child1;
+	}
+	const udword Sibling = Index;
+
+	// 2) Create a new parent. Careful, this can reallocate the nodes.
+	const udword OldParent = mNodes[Sibling].mParent;
+	const udword NewParent = AllocateNode();
+	DynamicTreeNode& Parent = mNodes[NewParent];
+	Parent.mParent = OldParent;
+	MergeBoxes(Parent.mBox, LeafBox, mNodes[Sibling].mBox);
+	Parent.mHeight = mNodes[Sibling].mHeight + 1;
+	Parent.mChild0 = Sibling;
+	Parent.mChild1 = leaf;
+	mNodes[Sibling].mParent = NewParent;
+	mNodes[leaf].mParent = NewParent;
+
+	if(OldParent!=INVALID_ID)
+	{
+		if(mNodes[OldParent].mChild0==Sibling)
+			mNodes[OldParent].mChild0 = NewParent;
+		else
+			mNodes[OldParent].mChild1 = NewParent;
+	}
+	else
+		mRoot = NewParent;
+
+	// 3) Walk back up the tree, fixing heights and boxes, and rotating where needed
+	Index = mNodes[leaf].mParent;
+	while(Index!=INVALID_ID)
+	{
+		Index = Balance(Index);
+
+		DynamicTreeNode& Node = mNodes[Index];
+		const DynamicTreeNode& Node0 = mNodes[Node.mChild0];
+		const DynamicTreeNode& Node1 = mNodes[Node.mChild1];
+		Node.mHeight = 1 + TMax(Node0.mHeight, Node1.mHeight);
+		MergeBoxes(Node.mBox, Node0.mBox, Node1.mBox);
+
+		Index = Node.mParent;
+	}
+}
+
+void DynamicTree::RemoveLeaf(udword leaf)
+{
+	if(leaf==mRoot)
+	{
+		mRoot = INVALID_ID;
+		return;
+	}
+
+	const udword Parent = mNodes[leaf].mParent;
+	const udword GrandParent = mNodes[Parent].mParent;
+	const udword Sibling = mNodes[Parent].mChild0==leaf ? mNodes[Parent].mChild1 : mNodes[Parent].mChild0;
+
+	if(GrandParent!=INVALID_ID)
+	{
+		// Destroy the parent and connect the sibling to the grand parent
+		if(mNodes[GrandParent].mChild0==Parent)
+			mNodes[GrandParent].mChild0 = Sibling;
+		else
+			mNodes[GrandParent].mChild1 = Sibling;
+		mNodes[Sibling].mParent = GrandParent;
+		FreeNode(Parent);
+
+		// Adjust ancestor bounds
+		udword Index = GrandParent;
+		while(Index!=INVALID_ID)
+		{
+			Index = Balance(Index);
+
+			DynamicTreeNode& Node = mNodes[Index];
+			const DynamicTreeNode& Node0 = mNodes[Node.mChild0];
+			const DynamicTreeNode& Node1 = mNodes[Node.mChild1];
+			MergeBoxes(Node.mBox, Node0.mBox, Node1.mBox);
+			Node.mHeight = 1 + TMax(Node0.mHeight, Node1.mHeight);
+
+			Index = Node.mParent;
+		}
+	}
+	else
+	{
+		mRoot = Sibling;
+		mNodes[Sibling].mParent = INVALID_ID;
+		FreeNode(Parent);
+	}
+}
+
+// Performs a left or right rotation if node A is imbalanced. Returns the new root of the subtree.
+udword DynamicTree::Balance(udword iA)
+{
+	DynamicTreeNode* A = mNodes + iA;
+	if(A->IsLeaf() || A->mHeight<2)
+		return iA;
+
+	const udword iB = A->mChild0;
+	const udword iC = A->mChild1;
+	DynamicTreeNode* B = mNodes + iB;
+	DynamicTreeNode* C = mNodes + iC;
+
+	const sdword Balance = C->mHeight - B->mHeight;
+
+	// Rotate C up
+	if(Balance>1)
+	{
+		const udword iF = C->mChild0;
+		const udword iG = C->mChild1;
+		DynamicTreeNode* F = mNodes + iF;
+		DynamicTreeNode* G = mNodes + iG;
+
+		// Swap A and C
+		C->mChild0 = iA;
+		C->mParent = A->mParent;
+		A->mParent = iC;
+
+		// A's old parent should point to C
+		if(C->mParent!=INVALID_ID)
+		{
+			if(mNodes[C->mParent].mChild0==iA)
+				mNodes[C->mParent].mChild0 = iC;
+			else
+				mNodes[C->mParent].mChild1 = iC;
+		}
+		else
+			mRoot = iC;
+
+		// Rotate
+		if(F->mHeight>G->mHeight)
+		{
+			C->mChild1 = iF;
+			A->mChild1 = iG;
+			G->mParent = iA;
+			MergeBoxes(A->mBox, B->mBox, G->mBox);
+			MergeBoxes(C->mBox, A->mBox, F->mBox);
+			A->mHeight = 1 + TMax(B->mHeight, G->mHeight);
+			C->mHeight = 1 + TMax(A->mHeight, F->mHeight);
+		}
+		else
+		{
+			C->mChild1 = iG;
+			A->mChild1 = iF;
+			F->mParent = iA;
+			MergeBoxes(A->mBox, B->mBox, F->mBox);
+			MergeBoxes(C->mBox, A->mBox, G->mBox);
+			A->mHeight = 1 + TMax(B->mHeight, F->mHeight);
+			C->mHeight = 1 + TMax(A->mHeight, G->mHeight);
+		}
+		return iC;
+	}
+
+	// Rotate B up
+	if(Balance<-1)
+	{
+		const udword iD = B->mChild0;
+		const udword iE = B->mChild1;
+		DynamicTreeNode* D = mNodes + iD;
+		DynamicTreeNode* E = mNodes + iE;
+
+		// Swap A and B
+		B->mChild0 = iA;
+		B->mParent = A->mParent;
+		A->mParent = iB;
+
+		// A's old parent should point to B
+		if(B->mParent!=INVALID_ID)
+		{
+			if(mNodes[B->mParent].mChild0==iA)
+				mNodes[B->mParent].mChild0 = iB;
+			else
+				mNodes[B->mParent].mChild1 = iB;
+		}
+		else
+			mRoot = iB;
+
+		// Rotate
+		if(D->mHeight>E->mHeight)
+		{
+			B->mChild1 = iD;
+			A->mChild0 = iE;
+			E->mParent = iA;
+			MergeBoxes(A->mBox, C->mBox, E->mBox);
+			MergeBoxes(B->mBox, A->mBox, D->mBox);
+			A->mHeight = 1 + TMax(C->mHeight, E->mHeight);
+			B->mHeight = 1 + TMax(A->mHeight, D->mHeight);
+		}
+		else
+		{
+			B->mChild1 = iE;
+			A->mChild0 = iD;
+			D->mParent = iA;
+			MergeBoxes(A->mBox, C->mBox, D->mBox);
+			MergeBoxes(B->mBox, A->mBox, E->mBox);
+			A->mHeight = 1 + TMax(C->mHeight, D->mHeight);
+			B->mHeight = 1 + TMax(A->mHeight, E->mHeight);
+		}
+		return iB;
+	}
+	return iA;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+ *	Creates a new proxy in the tree.
+ *	\param		box			[in] the object's tight box. The tree stores it fattened by the current margin.
+ *	\param		user_data	[in] the object's id, reported in the pairs
+ *	\return		proxy id
+ */
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+udword DynamicTree::CreateProxy(const AABB& box, udword user_data)
+{
+	const udword Proxy = AllocateNode();
+	FattenBox(mNodes[Proxy].mBox, box, mMargin);
+	mNodes[Proxy].mUserData = user_data;
+	InsertLeaf(Proxy);
+	MarkMoved(Proxy);
+	mNbProxies++;
+	return Proxy;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+ *	Removes a proxy from the tree.
+ *	\param		proxy		[in] proxy id, as returned by CreateProxy
+ */
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+void DynamicTree::DestroyProxy(udword proxy)
+{
+	ASSERT(proxy<mNbNodes && mNodes[proxy].IsLeaf());
+	RemoveLeaf(proxy);
+	FreeNode(proxy);
+	mNbProxies--;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+ *	Incremental update. The proxy is only reinserted when the new tight box escapes its fat box.
+ *	\param		proxy		[in] proxy id, as returned by CreateProxy
+ *	\param		box			[in] the object's new tight box
+ *	\return		true if the proxy has been reinserted
+ */
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+bool DynamicTree::MoveProxy(udword proxy, const AABB& box)
+{
+	ASSERT(proxy<mNbNodes && mNodes[proxy].IsLeaf());
+	if(ContainsBox(mNodes[proxy].mBox, box))
+		return false;
+
+	RemoveLeaf(proxy);
+	FattenBox(mNodes[proxy].mBox, box, mMargin);
+	InsertLeaf(proxy);
+	MarkMoved(proxy);
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+ *	Batch update. Replaces the proxy's box without touching the tree structure: call Refit() once all boxes have been
+ *	updated. Cheaper than MoveProxy when most objects move coherently, at the cost of a slowly degrading tree.
+ *	\param		proxy		[in] proxy id, as returned by CreateProxy
+ *	\param		box			[in] the object's new tight box
+ */
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+void DynamicTree::SetProxyBox(udword proxy, const AABB& box)
+{
+	ASSERT(proxy<mNbNodes && mNodes[proxy].IsLeaf());
+	if(ContainsBox(mNodes[proxy].mBox, box))
+		return;
+
+	FattenBox(mNodes[proxy].mBox, box, mMargin);
+	MarkMoved(proxy);
+}
+
+static void RefitNode(DynamicTreeNode* nodes, udword index)
+{
+	DynamicTreeNode& Node = nodes[index];
+	if(Node.IsLeaf())
+		return;
+
+	RefitNode(nodes, Node.mChild0);
+	RefitNode(nodes, Node.mChild1);
+	MergeBoxes(Node.mBox, nodes[Node.mChild0].mBox, nodes[Node.mChild1].mBox);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+ *	Recomputes the boxes of all internal nodes, bottom-up. To use after SetProxyBox calls.
+ */
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+void DynamicTree::Refit()
+{
+	if(mRoot!=INVALID_ID)
+		RefitNode(mNodes, mRoot);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+ *	Self-collision. Returns a list of overlapping pairs of proxies, as user ids.
+ *	\param		pairs	[out] list of overlapping pairs
+ *	\return		true if success.
+ */
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+bool DynamicTree::FindPairs(Container& pairs) const
+{
+	// Checkings
+	if(mRoot==INVALID_ID)
+		return false;
+
+	PairOutputBuffer POB(pairs);
+
+	// Simultaneous traversal of the tree against itself. A node paired with itself expands to its
+	// children paired with themselves, plus the two children paired with each other.
+	Container Stack;
+	Stack.Add(mRoot).Add(mRoot);
+	while(Stack.GetNbEntries())
+	{
+		const udword b = PopEntry(Stack);
+		const udword a = PopEntry(Stack);
+		const DynamicTreeNode& A = mNodes[a];
+		const DynamicTreeNode& B = mNodes[b];
+
+		if(a==b)
+		{
+			if(!A.IsLeaf())
+			{
+				Stack.Add(A.mChild0).Add(A.mChild0);
+				Stack.Add(A.mChild1).Add(A.mChild1);
+				Stack.Add(A.mChild0).Add(A.mChild1);
+			}
+			continue;
+		}
+
+		if(!A.mBox.Intersect(B.mBox))
+			continue;
+
+		if(A.IsLeaf() && B.IsLeaf())
+			ReportIntersection(POB, TMin(A.mUserData, B.mUserData), TMax(A.mUserData, B.mUserData));
+		else if(B.IsLeaf() || (!A.IsLeaf() && A.mHeight>=B.mHeight))
+		{
+			Stack.Add(A.mChild0).Add(b);
+			Stack.Add(A.mChild1).Add(b);
+		}
+		else
+		{
+			Stack.Add(a).Add(B.mChild0);
+			Stack.Add(a).Add(B.mChild1);
+		}
+	}
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+ *	Bipartite query. Returns a list of overlapping pairs of proxies, the first one from this tree, the second one from the other tree.
+ *	\param		tree	[in] the other tree
+ *	\param		pairs	[out] list of overlapping pairs
+ *	\return		true if success.
+ */
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+bool DynamicTree::FindPairs(const DynamicTree& tree, Container& pairs) const
+{
+	// Checkings
+	if(mRoot==INVALID_ID || tree.mRoot==INVALID_ID)
+		return false;
+
+	PairOutputBuffer POB(pairs);
+
+	Container Stack;
+	Stack.Add(mRoot).Add(tree.mRoot);
+	while(Stack.GetNbEntries())
+	{
+		const udword b = PopEntry(Stack);
+		const udword a = PopEntry(Stack);
+		const DynamicTreeNode& A = mNodes[a];
+		const DynamicTreeNode& B = tree.mNodes[b];
+
+		if(!A.mBox.Intersect(B.mBox))
+			continue;
+
+		if(A.IsLeaf() && B.IsLeaf())
+			ReportIntersection(POB, A.mUserData, B.mUserData);
+		else if(B.IsLeaf() || (!A.IsLeaf() && A.mHeight>=B.mHeight))
+		{
+			Stack.Add(A.mChild0).Add(b);
+			Stack.Add(A.mChild1).Add(b);
+		}
+		else
+		{
+			Stack.Add(a).Add(B.mChild0);
+			Stack.Add(a).Add(B.mChild1);
+		}
+	}
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+ *	Incremental query. Returns the overlapping pairs involving at least one proxy created, reinserted or updated since the
+ *	last call. Pairs between two such proxies are reported once. The list of moved proxies is reset afterwards.
+ *	\param		pairs	[out] list of overlapping pairs
+ *	\return		true if success.
+ */
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+bool DynamicTree::FindMovedPairs(Container& pairs)
+{
+	// Checkings
+	if(mRoot==INVALID_ID)
+		return false;
+
+	{
+		PairOutputBuffer POB(pairs);
+
+		Container Stack;
+		const udword NbMoved = mMoved.GetNbEntries();
+		for(udword i=0;i<NbMoved;i++)
+		{
+			const udword Proxy = mMoved.GetEntry(i);
+			const DynamicTreeNode& Query = mNodes[Proxy];
+
+			Stack.Reset();
+			Stack.Add(mRoot);
+			while(Stack.GetNbEntries())
+			{
+				const udword Index = PopEntry(Stack);
+				const DynamicTreeNode& Node = mNodes[Index];
+				if(!Node.mBox.Intersect(Query.mBox))
+					continue;
+
+				if(!Node.IsLeaf())
+				{
+					Stack.Add(Node.mChild0).Add(Node.mChild1);
+					continue;
+				}
+
+				// Skip self, and pairs of moved proxies that are reported from the other side
+				if(Index==Proxy || (Node.mMoved && Index<Proxy))
+					continue;
+
+				ReportIntersection(POB, TMin(Query.mUserData, Node.mUserData), TMax(Query.mUserData, Node.mUserData));
+			}
+		}
+	}
+
+	// Reset the moved list
+	const udword NbMoved = mMoved.GetNbEntries();
+	for(udword i=0;i<NbMoved;i++)
+		mNodes[mMoved.GetEntry(i)].mMoved = false;
+	mMoved.Reset();
+	return true;
+}
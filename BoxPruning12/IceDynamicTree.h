@@ -0,0 +1,79 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+ *	Contains code for the "box pruning revisited" project.
+ *	\file		IceDynamicTree.h
+ *	\author		Pierre Terdiman
+ *	\date		February 2017
+ */
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Include Guard
+#ifndef ICEDYNAMICTREE_H
+#define ICEDYNAMICTREE_H
+
+	//! A node of the dynamic tree. Leaves have no children, and store the user's id.
+	struct MESHMERIZER_API DynamicTreeNode
+	{
+		inline_	bool			IsLeaf()	const	{ return mChild0==INVALID_ID;	}
+
+				AABB			mBox;		//!< Fat box for leaves, union of the children for internal nodes
+				udword			mParent;	//!< Parent node, or next free node when the node isn't used
+				udword			mChild0;	//!< First child, INVALID_ID for leaves
+				udword			mChild1;	//!< Second child
+				sdword			mHeight;	//!< 0 for leaves, -1 for free nodes
+				udword			mUserData;	//!< User id, reported in the pairs
+				bool			mMoved;		//!< Leaf has been (re)inserted since the last FindMovedPairs() call
+	};
+
+	// Dynamic AABB tree, for scenes where few objects move and re-running CompleteBoxPruning every frame is wasteful.
+	// Leaves are stored with a margin ("fat" boxes), and are only reinserted when the object's tight box escapes its
+	// fat box. Insertion picks the sibling using a surface area cost, and the tree is kept balanced with rotations.
+	// Pairs are reported for overlapping fat boxes, so they're conservative.
+	class MESHMERIZER_API DynamicTree
+	{
+		public:
+		// Constructor/Destructor
+								DynamicTree();
+								~DynamicTree();
+
+		// Proxies
+				udword			CreateProxy(const AABB& box, udword user_data);
+				void			DestroyProxy(udword proxy);
+				bool			MoveProxy(udword proxy, const AABB& box);
+				void			SetProxyBox(udword proxy, const AABB& box);
+				void			Refit();
+
+		// Pair queries
+				bool			FindPairs(Container& pairs)							const;
+				bool			FindPairs(const DynamicTree& tree, Container& pairs)	const;
+				bool			FindMovedPairs(Container& pairs);
+
+		//! Sets the margin used to fatten the boxes. Only affects boxes inserted after the call.
+		inline_	void			SetMargin(float margin)					{ mMargin = margin;					}
+		inline_	float			GetMargin()						const	{ return mMargin;					}
+
+		inline_	const AABB&		GetFatBox(udword proxy)			const	{ return mNodes[proxy].mBox;		}
+		inline_	udword			GetUserData(udword proxy)		const	{ return mNodes[proxy].mUserData;	}
+		inline_	udword			GetNbProxies()					const	{ return mNbProxies;				}
+		inline_	sdword			GetHeight()						const	{ return mRoot==INVALID_ID ? 0 : mNodes[mRoot].mHeight;	}
+
+								PREVENT_COPY(DynamicTree)
+		private:
+				DynamicTreeNode*	mNodes;
+				udword			mNbNodes;		//!< Number of allocated nodes
+				udword			mFreeList;		//!< First free node
+				udword			mRoot;
+				udword			mNbProxies;
+				float			mMargin;
+				Container		mMoved;			//!< Leaves (re)inserted since the last FindMovedPairs() call
+		// Internal methods
+				udword			AllocateNode();
+				void			FreeNode(udword node);
+				void			InsertLeaf(udword leaf);
+				void			RemoveLeaf(udword leaf);
+				udword			Balance(udword node);
+				void			MarkMoved(udword leaf);
+	};
+
+#endif // ICEDYNAMICTREE_H
@@ -0,0 +1,33 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+ *	Contains the fat box helpers shared by the dynamic tree and the persistent box pruning.
+ *	\file		IceFatBox.h
+ *	\author		Pierre Terdiman
+ *	\date		February 2017
+ */
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Include Guard
+#ifndef ICEFATBOX_H
+#define ICEFATBOX_H
+
+// Returns true if box is inside fat, i.e. the fat box doesn't need to be updated
+static inline_ bool ContainsBox(const AABB& fat, const AABB& box)
+{
+	return	fat.mMin.x<=box.mMin.x && fat.mMin.y<=box.mMin.y && fat.mMin.z<=box.mMin.z
+		&&	box.mMax.x<=fat.mMax.x && box.mMax.y<=fat.mMax.y && box.mMax.z<=fat.mMax.z;
+}
+
+// Inflates box by margin on all sides
+static inline_ void FattenBox(AABB& fat, const AABB& box, float margin)
+{
+	fat.mMin.x = box.mMin.x - margin;
+	fat.mMin.y = box.mMin.y - margin;
+	fat.mMin.z = box.mMin.z - margin;
+	fat.mMax.x = box.mMax.x + margin;
+	fat.mMax.y = box.mMax.y + margin;
+	fat.mMax.z = box.mMax.z + margin;
+}
+
+#endif // ICEFATBOX_H
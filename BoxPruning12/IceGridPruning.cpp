@@ -0,0 +1,266 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+ *	Contains code for the "box pruning revisited" project.
+ *	\file		IceGridPruning.cpp
+ *	\author		Pierre Terdiman
+ *	\date		February 2017
+ */
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Precompiled Header
+#include "Stdafx.h"
+#include "IcePairOutputBuffer.h"
+
+using namespace Meshmerizer;
+
+// Boxes touching more cells than this are not inserted in the grid. They're tested against
+// everything else in a separate brute-force pass instead, so that a handful of huge boxes
+// can't blow up the cell lists.
+static const udword kMaxCellsPerBox = 256;
+// Max number of hash buckets per box, and overall
+static const udword kMaxBucketsPerBox = 8;
+static const udword kMaxNbBuckets = 1<<26;
+// Cell coordinates are clamped to this range, so that they fit in an sdword and so do the spans
+static const float kMaxCellCoord = float(1<<29);
+
+// Classic spatial hash (Teschner et al.)
+static inline_ udword HashCell(sdword x, sdword y, sdword z, udword mask)
+{
+	return ((udword(x)*73856093u) ^ (udword(y)*19349663u) ^ (udword(z)*83492791u)) & mask;
+}
+
+static inline_ sdword CellCoord(float f, float inv_cell_size)
+{
+	// Far away boxes end up in the same border cells, which is slow but still correct. NaNs go to the min.
+	float c = floorf(f * inv_cell_size);
+	if(!(c>-kMaxCellCoord))	c = -kMaxCellCoord;
+	if(c>kMaxCellCoord)		c = kMaxCellCoord;
+	return sdword(c);
+}
+
+// Returns the k-th smallest value. The array is partially reordered (Hoare's selection).
+static float SelectKth(float* values, udword nb, udword k)
+{
+	sdword Left = 0;
+	sdword Right = sdword(nb) - 1;
+	while(Left<Right)
+	{
+		const float Pivot = values[Left + ((Right-Left)>>1)];
+		sdword i = Left;
+		sdword j = Right;
+		while(i<=j)
+		{
+			while(values[i]<Pivot)	i++;
+			while(Pivot<values[j])	j--;
+			if(i<=j)
+			{
+				TSwap(values[i], values[j]);
+				i++;
+				j--;
+			}
+		}
+		if(sdword(k)<=j)		Right = j;
+		else if(sdword(k)>=i)	Left = i;
+		else					break;
+	}
+	return values[k];
+}
+
+// Integer cell bounds of a box
+struct CellBounds
+{
+	sdword	mMinX, mMinY, mMinZ;
+	sdword	mMaxX, mMaxY, mMaxZ;
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+ *	Complete box pruning using a hashed uniform grid. Returns a list of overlapping pairs of boxes, each box of the pair belongs to the same set.
+ *	The cell size is the median of the boxes' largest extents. Boxes are stored in the hash buckets using a counting-sort layout, and a
+ *	pair spanning several cells is only reported from the cell containing the min corner of the two boxes' intersection.
+ *	\param		nb		[in] number of boxes
+ *	\param		list	[in] list of boxes
+ *	\param		pairs	[out] list of overlapping pairs
+ *	\return		true if success, false if the grid would need 2^31 entries or more.
+ */
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+bool Meshmerizer::GridBoxPruning(udword nb, const AABB* list, Container& pairs)
+{
+	// Checkings
+	if(!nb || !list)
+		return false;
+
+	// 1) Pick the cell size. Median of the largest extents, so that a typical box touches 1 to 8 cells.
+	float CellSize;
+	{
+		float* Extents = new float[nb];
+		for(udword i=0;i<nb;i++)
+		{
+			const AABB& Box = list[i];
+			Extents[i] = TMax(TMax(Box.mMax.x - Box.mMin.x, Box.mMax.y - Box.mMin.y), Box.mMax.z - Box.mMin.z);
+		}
+
+		CellSize = SelectKth(Extents, nb, nb>>1);
+		DELETEARRAY(Extents);
+	}
+	if(!(CellSize>0.0f))
+		CellSize = 1.0f;	// All points, any size will do
+	const float InvCellSize = 1.0f / CellSize;
+
+	// 2) Compute cell bounds, and count the cells we're going to insert
+	CellBounds* Bounds = new CellBounds[nb];
+	udword* LargeBoxes = new udword[nb];
+	udword NbLargeBoxes = 0;
+	uqword NbCells = 0;
+	for(udword i=0;i<nb;i++)
+	{
+		const AABB& Box = list[i];
+		CellBounds& CB = Bounds[i];
+		CB.mMinX = CellCoord(Box.mMin.x, InvCellSize);
+		CB.mMinY = CellCoord(Box.mMin.y, InvCellSize);
+		CB.mMinZ = CellCoord(Box.mMin.z, InvCellSize);
+		CB.mMaxX = CellCoord(Box.mMax.x, InvCellSize);
+		CB.mMaxY = CellCoord(Box.mMax.y, InvCellSize);
+		CB.mMaxZ = CellCoord(Box.mMax.z, InvCellSize);
+
+		// Checked per axis first so that the product can't overflow
+		const udword SpanX = udword(CB.mMaxX - CB.mMinX + 1);
+		const udword SpanY = udword(CB.mMaxY - CB.mMinY + 1);
+		const udword SpanZ = udword(CB.mMaxZ - CB.mMinZ + 1);
+		const udword NbBoxCells = (SpanX>kMaxCellsPerBox || SpanY>kMaxCellsPerBox || SpanZ>kMaxCellsPerBox) ? kMaxCellsPerBox+1 : SpanX*SpanY*SpanZ;
+		if(NbBoxCells>kMaxCellsPerBox)
+		{
+			// Flag as large, it won't go in the grid
+			LargeBoxes[NbLargeBoxes++] = i;
+			CB.mMaxX = CB.mMinX - 1;
+		}
+		else
+			NbCells += NbBoxCells;
+	}
+
+	// Entries are counted with udwords
+	if(NbCells>=0x80000000)
+	{
+		DELETEARRAY(LargeBoxes);
+		DELETEARRAY(Bounds);
+		return false;
+	}
+
+	// Power-of-two number of buckets, about one per inserted cell, within limits
+	const uqword MaxNbBuckets = TMin(uqword(nb)*kMaxBucketsPerBox, uqword(kMaxNbBuckets));
+	udword NbBuckets = 1;
+	while(NbBuckets<NbCells && NbBuckets<MaxNbBuckets)
+		NbBuckets<<=1;
+	const udword Mask = NbBuckets - 1;
+
+	// 3) Counting sort: count entries per bucket. A box touching several cells that hash to the same
+	// bucket is only inserted once there, which LastBox keeps track of.
+	udword* Offsets = new udword[NbBuckets+1];
+	udword* LastBox = new udword[NbBuckets];
+	ZeroMemory(Offsets, (NbBuckets+1)*sizeof(udword));
+	FillMemory(LastBox, NbBuckets*sizeof(udword), 0xff);
+
+	for(udword i=0;i<nb;i++)
+	{
+		const CellBounds& CB = Bounds[i];
+		for(sdword z=CB.mMinZ;z<=CB.mMaxZ;z++)
+		for(sdword y=CB.mMinY;y<=CB.mMaxY;y++)
+		for(sdword x=CB.mMinX;x<=CB.mMaxX;x++)
+		{
+			const udword h = HashCell(x, y, z, Mask);
+			if(LastBox[h]!=i)
+			{
+				LastBox[h] = i;
+				Offsets[h+1]++;
+			}
+		}
+	}
+
+	// Turn counts into offsets
+	for(udword i=0;i<NbBuckets;i++)
+		Offsets[i+1] += Offsets[i];
+
+	// 4) Scatter. Boxes are processed in order so each bucket ends up sorted by box index.
+	udword* Entries = new udword[Offsets[NbBuckets]];
+	{
+		udword* Cursor = new udword[NbBuckets];
+		CopyMemory(Cursor, Offsets, NbBuckets*sizeof(udword));
+		FillMemory(LastBox, NbBuckets*sizeof(udword), 0xff);
+
+		for(udword i=0;i<nb;i++)
+		{
+			const CellBounds& CB = Bounds[i];
+			for(sdword z=CB.mMinZ;z<=CB.mMaxZ;z++)
+			for(sdword y=CB.mMinY;y<=CB.mMaxY;y++)
+			for(sdword x=CB.mMinX;x<=CB.mMaxX;x++)
+			{
+				const udword h = HashCell(x, y, z, Mask);
+				if(LastBox[h]!=i)
+				{
+					LastBox[h] = i;
+					Entries[Cursor[h]++] = i;
+				}
+			}
+		}
+		DELETEARRAY(Cursor);
+	}
+	DELETEARRAY(LastBox);
+
+	// Our pair output buffer
+	PairOutputBuffer POB(pairs);
+
+	// 5) Test boxes sharing a bucket. The pair is only reported from the bucket of its "owner" cell, i.e.
+	// the cell containing the min corner of the intersection. Both boxes touch that cell by definition, so
+	// exactly one bucket reports it, regardless of hash collisions.
+	for(udword h=0;h<NbBuckets;h++)
+	{
+		const udword* Bucket = Entries + Offsets[h];
+		const udword NbEntries = Offsets[h+1] - Offsets[h];
+
+		for(udword j=0;j<NbEntries;j++)
+		{
+			const udword Index0 = Bucket[j];
+			const AABB& Box0 = list[Index0];
+			const CellBounds& CB0 = Bounds[Index0];
+
+			for(udword k=j+1;k<NbEntries;k++)
+			{
+				const udword Index1 = Bucket[k];
+				if(!Box0.Intersect(list[Index1]))
+					continue;
+
+				const CellBounds& CB1 = Bounds[Index1];
+				const udword Owner = HashCell(TMax(CB0.mMinX, CB1.mMinX), TMax(CB0.mMinY, CB1.mMinY), TMax(CB0.mMinZ, CB1.mMinZ), Mask);
+				if(Owner==h)
+					ReportIntersection(POB, Index0, Index1);
+			}
+		}
+	}
+
+	// 6) Large boxes against everything. Large-vs-large pairs are reported once, from the smaller index.
+	for(udword j=0;j<NbLargeBoxes;j++)
+	{
+		const udword Index0 = LargeBoxes[j];
+		const AABB& Box0 = list[Index0];
+		for(udword i=0;i<nb;i++)
+		{
+			if(i==Index0)
+				continue;
+
+			// Skip large boxes we already tested against
+			const CellBounds& CB = Bounds[i];
+			if(CB.mMaxX<CB.mMinX && i<Index0)
+				continue;
+
+			if(Box0.Intersect(list[i]))
+				ReportIntersection(POB, TMin(Index0, i), TMax(Index0, i));
+		}
+	}
+
+	DELETEARRAY(Entries);
+	DELETEARRAY(Offsets);
+	DELETEARRAY(LargeBoxes);
+	DELETEARRAY(Bounds);
+	return true;
+}
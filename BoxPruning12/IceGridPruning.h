@@ -0,0 +1,18 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+ *	Contains code for the "box pruning revisited" project.
+ *	\file		IceGridPruning.h
+ *	\author		Pierre Terdiman
+ *	\date		February 2017
+ */
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Include Guard
+#ifndef ICEGRIDPRUNING_H
+#define ICEGRIDPRUNING_H
+
+	// Hashed uniform grid, same interface as CompleteBoxPruning
+	FUNCTION MESHMERIZER_API bool GridBoxPruning(udword nb, const AABB* list, Container& pairs);
+
+#endif // ICEGRIDPRUNING_H
@@ -0,0 +1,103 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+ *	Contains code for the "box pruning revisited" project.
+ *	\file		IceMorton.cpp
+ *	\author		Pierre Terdiman
+ *	\date		February 2017
+ */
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Precompiled Header
+#include "Stdafx.h"
+
+using namespace Meshmerizer;
+
+// Spreads the 10 low bits of x so that there are 2 zero bits between each of them
+static inline_ udword SpreadBits10(udword x)
+{
+	x &= 0x000003ff;
+	x = (x | (x << 16)) & 0xff0000ff;
+	x = (x | (x <<  8)) & 0x0300f00f;
+	x = (x | (x <<  4)) & 0x030c30c3;
+	x = (x | (x <<  2)) & 0x09249249;
+	return x;
+}
+
+// Quantizes a coordinate to 10 bits
+static inline_ udword Quantize10(float f, float offset, float scale)
+{
+	const float q = (f - offset) * scale;
+	if(!(q>0.0f))
+		return 0;
+	return q<1023.0f ? udword(q) : 1023;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+ *	Computes 30-bit Morton codes for a list of boxes. Box centers are quantized to 10 bits per axis within the bounds of the whole list,
+ *	and interleaved (X in bit 0, Y in bit 1, Z in bit 2, and so on).
+ *	\param		nb		[in] number of boxes
+ *	\param		list	[in] list of boxes
+ *	\param		codes	[out] one Morton code per box
+ *	\return		true if success.
+ */
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+bool Meshmerizer::ComputeMortonCodes(udword nb, const AABB* list, udword* codes)
+{
+	// Checkings
+	if(!nb || !list || !codes)
+		return false;
+
+	// Bounds of the box centers. We work with Min+Max, i.e. twice the center, it doesn't change the codes.
+	Point Min(list[0].mMin + list[0].mMax);
+	Point Max(Min);
+	for(udword i=1;i<nb;i++)
+	{
+		const Point Center2 = list[i].mMin + list[i].mMax;
+		Min.x = TMin(Min.x, Center2.x);	Max.x = TMax(Max.x, Center2.x);
+		Min.y = TMin(Min.y, Center2.y);	Max.y = TMax(Max.y, Center2.y);
+		Min.z = TMin(Min.z, Center2.z);	Max.z = TMax(Max.z, Center2.z);
+	}
+
+	// Same scale on all axes, so that cells are cubes
+	const float Extent = TMax(TMax(Max.x - Min.x, Max.y - Min.y), Max.z - Min.z);
+	const float Scale = Extent>0.0f ? 1023.0f / Extent : 0.0f;
+
+	for(udword i=0;i<nb;i++)
+	{
+		const Point Center2 = list[i].mMin + list[i].mMax;
+		const udword x = Quantize10(Center2.x, Min.x, Scale);
+		const udword y = Quantize10(Center2.y, Min.y, Scale);
+		const udword z = Quantize10(Center2.z, Min.z, Scale);
+		codes[i] = SpreadBits10(x) | (SpreadBits10(y)<<1) | (SpreadBits10(z)<<2);
+	}
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+ *	Computes a Morton order for a list of boxes. This is an optional preprocessing step: callers can reorder their objects once using
+ *	the permutation (i.e. new object i = old object permutation[i]), after which the ids reported by the pruning functions are spatially
+ *	coherent, and accessing the objects from the pairs (remap lookups, narrowphase) touches memory in a much more cache-friendly way.
+ *	\param		nb			[in] number of boxes
+ *	\param		list		[in] list of boxes
+ *	\param		permutation	[out] nb box indices, sorted in Morton order
+ *	\param		sorter		[in] sorter used for the codes, owned by the caller so that concurrent calls don't share it
+ *	\return		true if success.
+ */
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+bool Meshmerizer::ComputeMortonOrder(udword nb, const AABB* list, udword* permutation, RadixSort& sorter)
+{
+	// Checkings
+	if(!nb || !list || !permutation)
+		return false;
+
+	// The codes are computed in the output buffer, which is overwritten with the ranks once they're sorted
+	ComputeMortonCodes(nb, list, permutation);
+
+	// Codes are 30 bits, so with 8-bit digits the top pass is skipped
+	const udword* Sorted = sorter.Sort(permutation, nb, false).GetRanks();
+	CopyMemory(permutation, Sorted, nb*sizeof(udword));
+	return true;
+}
\ No newline at end of file
@@ -0,0 +1,19 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+ *	Contains code for the "box pruning revisited" project.
+ *	\file		IceMorton.h
+ *	\author		Pierre Terdiman
+ *	\date		February 2017
+ */
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Include Guard
+#ifndef ICEMORTON_H
+#define ICEMORTON_H
+
+	// Morton-order reindexing, to make pair ids spatially coherent
+	FUNCTION MESHMERIZER_API bool ComputeMortonCodes(udword nb, const AABB* list, udword* codes);
+	FUNCTION MESHMERIZER_API bool ComputeMortonOrder(udword nb, const AABB* list, udword* permutation, RadixSort& sorter);
+
+#endif // ICEMORTON_H
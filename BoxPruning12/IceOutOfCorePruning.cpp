@@ -0,0 +1,527 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+ *	Contains code for the "box pruning revisited" project.
+ *	\file		IceOutOfCorePruning.cpp
+ *	\author		Pierre Terdiman
+ *	\date		February 2017
+ */
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Precompiled Header
+#include "Stdafx.h"
+
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+
+using namespace Meshmerizer;
+
+// Box files can be larger than 2 GB
+#define FSEEK64	_fseeki64
+
+// Minimum number of boxes buffered per run during the merge. Smaller reads are dominated by seeks.
+static const udword kMinRunBufferSize = 4096;
+// Max number of runs merged at once. Runs are merged in several passes when there are more, so that we stay well below the
+// CRT's limit of 512 open streams.
+static const udword kMaxMergeFanIn = 256;
+// Number of pairs buffered before writing them to the pair file
+static const udword kPairBufferSize = 65536;
+// Longest temp file name
+static const udword kMaxPathLength = 512;
+
+// Makes the run file names unique across concurrent calls
+static volatile long gNbOutOfCoreCalls = 0;
+
+// A box and its index in the box file. This is what the runs are made of.
+struct StreamedBox
+{
+	AABB	mBox;
+	udword	mId;
+};
+
+// Sequential reader for the boxes of a box file, regardless of its layout. SoA files use one stream per array.
+class BoxFileReader
+{
+	public:
+				BoxFileReader() : mLayout(BOX_FILE_AOS), mNbBoxes(0), mNbRead(0)	{ ZeroMemory(mFiles, sizeof(mFiles));	}
+				~BoxFileReader()
+				{
+					for(udword j=0;j<6;j++)
+						if(mFiles[j])
+							fclose(mFiles[j]);
+				}
+
+	bool		Open(const char* filename)
+	{
+		FILE* fp = null;
+		if(fopen_s(&fp, filename, "rb"))
+			return false;
+		mFiles[0] = fp;
+
+		BoxFileHeader Header;
+		if(fread(&Header, sizeof(BoxFileHeader), 1, fp)!=1
+			|| Header.mMagic!=BOX_FILE_MAGIC || Header.mVersion!=BOX_FILE_VERSION
+			|| (Header.mLayout!=BOX_FILE_AOS && Header.mLayout!=BOX_FILE_SOA))
+			return false;
+
+		mLayout = BoxFileLayout(Header.mLayout);
+		mNbBoxes = Header.mNbBoxes;
+		if(mLayout==BOX_FILE_AOS)
+			return FSEEK64(fp, Header.mPayloadOffset, SEEK_SET)==0;
+
+		const uqword ArrayBytes = uqword(GetBoxFileArrayStride(mNbBoxes))*sizeof(float);
+		for(udword j=0;j<6;j++)
+		{
+			if(j && fopen_s(&mFiles[j], filename, "rb"))
+				return false;
+			if(FSEEK64(mFiles[j], Header.mPayloadOffset + ArrayBytes*j, SEEK_SET))
+				return false;
+		}
+		return true;
+	}
+
+	// Reads the next boxes, returns the number of boxes read (0 at the end of the file or on error)
+	udword		Read(StreamedBox* boxes, udword max_nb, float* tmp)
+	{
+		const udword Nb = TMin(max_nb, mNbBoxes - mNbRead);
+		if(!Nb)
+			return 0;
+
+		if(mLayout==BOX_FILE_AOS)
+		{
+			AABB* Boxes = (AABB*)tmp;
+			if(fread(Boxes, sizeof(AABB)*Nb, 1, mFiles[0])!=1)
+				return 0;
+			for(udword i=0;i<Nb;i++)
+			{
+				boxes[i].mBox = Boxes[i];
+				boxes[i].mId = mNbRead + i;
+			}
+		}
+		else
+		{
+			for(udword j=0;j<6;j++)
+			{
+				if(fread(tmp, sizeof(float)*Nb, 1, mFiles[j])!=1)
+					return 0;
+				for(udword i=0;i<Nb;i++)
+				{
+					if(j<3)	boxes[i].mBox.mMin[j] = tmp[i];
+					else	boxes[i].mBox.mMax[j-3] = tmp[i];
+				}
+			}
+			for(udword i=0;i<Nb;i++)
+				boxes[i].mId = mNbRead + i;
+		}
+		mNbRead += Nb;
+		return Nb;
+	}
+
+	inline_	udword	GetNbBoxes()	const	{ return mNbBoxes;	}
+
+	private:
+	FILE*			mFiles[6];
+	BoxFileLayout	mLayout;
+	udword			mNbBoxes;
+	udword			mNbRead;
+};
+
+// Buffered reader for a sorted run
+struct RunReader
+{
+	FILE*			mFile;
+	StreamedBox*	mBuffer;
+	udword			mBufferSize;
+	udword			mNbInBuffer;
+	udword			mCurrent;
+	udword			mNbLeft;	//!< Boxes left in the file, not counting the buffered ones
+
+	inline_	const StreamedBox&	GetCurrent()	const	{ return mBuffer[mCurrent];	}
+
+	// Moves to the next box, returns false when the run is exhausted or on read error
+	bool	Next()
+	{
+		if(++mCurrent<mNbInBuffer)
+			return true;
+		return Refill();
+	}
+
+	bool	Refill()
+	{
+		mCurrent = 0;
+		mNbInBuffer = TMin(mBufferSize, mNbLeft);
+		if(!mNbInBuffer || fread(mBuffer, sizeof(StreamedBox)*mNbInBuffer, 1, mFile)!=1)
+		{
+			mNbInBuffer = 0;
+			return false;
+		}
+		mNbLeft -= mNbInBuffer;
+		return true;
+	}
+};
+
+static inline_ bool RunLess(const RunReader* runs, udword a, udword b)
+{
+	return runs[a].GetCurrent().mBox.mMin.x < runs[b].GetCurrent().mBox.mMin.x;
+}
+
+// Min-heap of run indices, keyed by the MinX of each run's current box
+static void SiftDown(udword* heap, udword nb, udword i, const RunReader* runs)
+{
+	for(;;)
+	{
+		const udword Left = i*2+1;
+		if(Left>=nb)
+			break;
+		udword Child = Left;
+		if(Left+1<nb && RunLess(runs, heap[Left+1], heap[Left]))
+			Child = Left+1;
+		if(!RunLess(runs, heap[Child], heap[i]))
+			break;
+		TSwap(heap[Child], heap[i]);
+		i = Child;
+	}
+}
+
+// Run file names start with the temp path, then the process and call ids, so that concurrent calls don't share runs
+static void GetRunPrefix(char* buffer, const char* temp_path)
+{
+	const udword CallId = udword(InterlockedIncrement(&gNbOutOfCoreCalls));
+	sprintf_s(buffer, kMaxPathLength, "%.*s%sboxes_%u_%u", int(kMaxPathLength-64), temp_path ? temp_path : "", temp_path ? "/" : "", udword(GetCurrentProcessId()), CallId);
+}
+
+static void GetRunFilename(char* buffer, const char* run_prefix, udword run)
+{
+	sprintf_s(buffer, kMaxPathLength, "%s_run%u.tmp", run_prefix, run);
+}
+
+static void DeleteRuns(const char* run_prefix, udword nb_runs)
+{
+	char Filename[kMaxPathLength];
+	for(udword i=0;i<nb_runs;i++)
+	{
+		GetRunFilename(Filename, run_prefix, i);
+		remove(Filename);
+	}
+}
+
+// Merges a range of sorted runs into a single stream sorted along X
+class RunMerger
+{
+	public:
+				RunMerger() : mRuns(null), mHeap(null), mNbRuns(0), mHeapSize(0), mError(false)	{}
+				~RunMerger()	{ Release();	}
+
+	// Opens the runs first_run to first_run+nb_runs-1, with buffer_size boxes buffered per run
+	bool		Init(const char* run_prefix, udword first_run, udword nb_runs, const udword* run_sizes, udword buffer_size)
+	{
+		Release();
+		mError = false;
+		mRuns = new RunReader[nb_runs];
+		ZeroMemory(mRuns, nb_runs*sizeof(RunReader));
+		mHeap = new udword[nb_runs];
+		mNbRuns = nb_runs;
+
+		for(udword i=0;i<nb_runs;i++)
+		{
+			char Filename[kMaxPathLength];
+			GetRunFilename(Filename, run_prefix, first_run+i);
+
+			RunReader& Run = mRuns[i];
+			fopen_s(&Run.mFile, Filename, "rb");
+			Run.mBuffer = new StreamedBox[buffer_size];
+			Run.mBufferSize = buffer_size;
+			Run.mNbLeft = run_sizes[first_run+i];
+			if(!Run.mFile || !Run.Refill())
+				return false;
+			mHeap[mHeapSize++] = i;
+		}
+
+		for(udword i=mHeapSize/2;i--;)
+			SiftDown(mHeap, mHeapSize, i, mRuns);
+		return true;
+	}
+
+	// Returns the next box along X. Returns false once all the runs are exhausted, or on read error (see HasError).
+	bool		Next(StreamedBox& box)
+	{
+		if(!mHeapSize)
+			return false;
+
+		RunReader& Run = mRuns[mHeap[0]];
+		box = Run.GetCurrent();
+		if(!Run.Next())
+		{
+			if(Run.mNbLeft)
+			{
+				mError = true;
+				mHeapSize = 0;
+				return false;
+			}
+			mHeap[0] = mHeap[--mHeapSize];
+		}
+		SiftDown(mHeap, mHeapSize, 0, mRuns);
+		return true;
+	}
+
+	inline_	bool	HasError()	const	{ return mError;	}
+
+	void		Release()
+	{
+		for(udword i=0;i<mNbRuns;i++)
+		{
+			if(mRuns[i].mFile)
+				fclose(mRuns[i].mFile);
+			DELETEARRAY(mRuns[i].mBuffer);
+		}
+		DELETEARRAY(mHeap);
+		DELETEARRAY(mRuns);
+		mNbRuns = 0;
+		mHeapSize = 0;
+	}
+
+	private:
+	RunReader*	mRuns;
+	udword*		mHeap;
+	udword		mNbRuns;
+	udword		mHeapSize;
+	bool		mError;
+};
+
+// Merges nb_runs runs, starting at first_run, into the new run out_run. The merged runs are deleted.
+static bool MergeRuns(const char* run_prefix, udword first_run, udword nb_runs, udword out_run, udword* run_sizes, udword buffer_size)
+{
+	bool Status;
+	{
+		RunMerger Merger;
+		Status = Merger.Init(run_prefix, first_run, nb_runs, run_sizes, buffer_size);
+
+		char Filename[kMaxPathLength];
+		GetRunFilename(Filename, run_prefix, out_run);
+		FILE* fp = null;
+		if(Status)
+			fopen_s(&fp, Filename, "wb");
+		Status &= fp!=null;
+
+		StreamedBox* Buffer = new StreamedBox[buffer_size];
+		udword NbBuffered = 0;
+		udword NbMerged = 0;
+		StreamedBox Box;
+		while(Status && Merger.Next(Box))
+		{
+			Buffer[NbBuffered++] = Box;
+			NbMerged++;
+			if(NbBuffered==buffer_size)
+			{
+				Status = fwrite(Buffer, sizeof(StreamedBox)*NbBuffered, 1, fp)==1;
+				NbBuffered = 0;
+			}
+		}
+		if(Status && NbBuffered)
+			Status = fwrite(Buffer, sizeof(StreamedBox)*NbBuffered, 1, fp)==1;
+		Status &= !Merger.HasError();
+		if(fp)
+			Status &= fclose(fp)==0;
+		DELETEARRAY(Buffer);
+
+		run_sizes[out_run] = NbMerged;
+	}
+
+	// Inputs are deleted as soon as possible to limit disk usage. The merger closed them already.
+	char Filename[kMaxPathLength];
+	for(udword i=0;i<nb_runs;i++)
+	{
+		GetRunFilename(Filename, run_prefix, first_run+i);
+		remove(Filename);
+	}
+	return Status;
+}
+
+// Pass 1: reads the boxes in chunks of max_nb_boxes, sorts each chunk along X, and writes it to its own run file.
+// Fails if the file doesn't contain as many boxes as its header says.
+static bool CreateRuns(BoxFileReader& reader, const char* run_prefix, udword max_nb_boxes, udword* run_sizes, udword& nb_runs)
+{
+	StreamedBox* Chunk = new StreamedBox[max_nb_boxes];
+	StreamedBox* Sorted = new StreamedBox[max_nb_boxes];
+	float* Tmp = new float[size_t(max_nb_boxes)*6];	// Large enough for max_nb_boxes AABBs
+	float* Keys = new float[max_nb_boxes];
+	RadixSort RS;
+	RS.SetMode(RADIX_AUTO);
+
+	bool Status = true;
+	nb_runs = 0;
+	udword NbRead = 0;
+	udword Nb;
+	while(Status && (Nb = reader.Read(Chunk, max_nb_boxes, Tmp))!=0)
+	{
+		NbRead += Nb;
+		for(udword i=0;i<Nb;i++)
+			Keys[i] = Chunk[i].mBox.mMin.x;
+		const udword* Ranks = RS.Sort(Keys, Nb).GetRanks();
+		for(udword i=0;i<Nb;i++)
+			Sorted[i] = Chunk[Ranks[i]];
+
+		char Filename[kMaxPathLength];
+		run_sizes[nb_runs] = Nb;
+		GetRunFilename(Filename, run_prefix, nb_runs++);
+		FILE* fp = null;
+		fopen_s(&fp, Filename, "wb");
+		Status = fp && fwrite(Sorted, sizeof(StreamedBox)*Nb, 1, fp)==1;
+		if(fp)
+			Status &= fclose(fp)==0;
+	}
+
+	// Read() also stops on errors, e.g. a truncated file
+	if(NbRead!=reader.GetNbBoxes())
+		Status = false;
+
+	DELETEARRAY(Keys);
+	DELETEARRAY(Tmp);
+	DELETEARRAY(Sorted);
+	DELETEARRAY(Chunk);
+	return Status;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+ *	Out-of-core complete box pruning, for box files that don't fit in memory.
+ *
+ *	The boxes are first read in chunks of max_nb_boxes, each chunk is radix-sorted along X and written to a temporary "run" file.
+ *	The runs are then merged, and the merged stream - sorted along X - is swept in a single pass. Only the active window is kept in
+ *	memory, i.e. the boxes whose MaxX is above the current MinX. Overlapping pairs are streamed to the pair file as raw pairs of
+ *	udword box indices. At most kMaxMergeFanIn runs are merged at once: when there are more, groups of runs are first merged into
+ *	larger intermediate runs, which costs one more read and write of the merged boxes per pass.
+ *
+ *	Memory usage is about 100 bytes per box of max_nb_boxes while sorting the runs (two copies of the chunk, the read buffer, the
+ *	keys and the sorter's ranks), then max_nb_boxes boxes for the merge buffers (but at least kMinRunBufferSize boxes per merged
+ *	run), plus the active window, which only depends on the boxes' distribution along X.
+ *
+ *	\param		box_filename	[in] input box file (see SaveBoxFile)
+ *	\param		pair_filename	[in] output pair file
+ *	\param		temp_path		[in] directory for the temporary files, or null for the current directory
+ *	\param		max_nb_boxes	[in] max number of boxes to sort in memory at once
+ *	\param		nb_pairs		[out] number of pairs written to the pair file (can be null)
+ *	\return		true if success.
+ */
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+bool Meshmerizer::OutOfCoreBoxPruning(const char* box_filename, const char* pair_filename, const char* temp_path, udword max_nb_boxes, uqword* nb_pairs)
+{
+	// Checkings
+	if(!box_filename || !pair_filename || !max_nb_boxes)
+		return false;
+
+	if(nb_pairs)
+		*nb_pairs = 0;
+
+	BoxFileReader Reader;
+	if(!Reader.Open(box_filename))
+		return false;
+
+	FILE* PairFile = null;
+	if(fopen_s(&PairFile, pair_filename, "wb"))
+		return false;
+
+	// No need for chunks larger than the file, which also keeps the buffer sizes reasonable
+	max_nb_boxes = TMax(udword(1), TMin(max_nb_boxes, Reader.GetNbBoxes()));
+
+	char RunPrefix[kMaxPathLength];
+	GetRunPrefix(RunPrefix, temp_path);
+
+	// 1) Sorted runs. Each merge pass creates one run from at least two, so there are less than twice as many runs in total.
+	const udword MaxNbRuns = (Reader.GetNbBoxes() + max_nb_boxes - 1)/max_nb_boxes;
+	udword* RunSizes = new udword[size_t(MaxNbRuns)*2+1];
+	udword NbRuns;
+	bool Status = CreateRuns(Reader, RunPrefix, max_nb_boxes, RunSizes, NbRuns);
+
+	// The merge buffers take about max_nb_boxes boxes in total, and each of them at least kMinRunBufferSize
+	const udword FanIn = TClamp(max_nb_boxes/kMinRunBufferSize, udword(2), kMaxMergeFanIn);
+	const udword BufferSize = TMax(kMinRunBufferSize, max_nb_boxes/FanIn);
+
+	// 2) Intermediate merge passes, until there are few enough runs left for the final one. The live runs are always the
+	// range FirstRun..NbCreated-1.
+	udword FirstRun = 0;
+	udword NbCreated = NbRuns;
+	while(Status && NbCreated-FirstRun>FanIn)
+	{
+		Status = MergeRuns(RunPrefix, FirstRun, FanIn, NbCreated, RunSizes, BufferSize);
+		FirstRun += FanIn;
+		NbCreated++;
+	}
+
+	// 3) Final merge and sweep
+	RunMerger Merger;
+	if(Status)
+		Status = Merger.Init(RunPrefix, FirstRun, NbCreated-FirstRun, RunSizes, BufferSize);
+
+	// Active window, compacted in place as boxes leave it
+	StreamedBox* ActiveBoxes = null;
+	udword NbActive = 0;
+	udword MaxNbActive = 0;
+	udword* PairBuffer = new udword[kPairBufferSize*2];
+	udword NbBuffered = 0;
+	uqword NbPairs = 0;
+
+	StreamedBox Current;
+	while(Status && Merger.Next(Current))
+	{
+		// Sweep: drop boxes that end before the current one starts, test the others in Y/Z
+		const float MinLimit = Current.mBox.mMin.x;
+		udword j=0;
+		while(j<NbActive)
+		{
+			const StreamedBox& Box = ActiveBoxes[j];
+			if(Box.mBox.mMax.x < MinLimit)
+			{
+				ActiveBoxes[j] = ActiveBoxes[--NbActive];
+				continue;
+			}
+
+			if(		!(Box.mBox.mMax.y < Current.mBox.mMin.y || Current.mBox.mMax.y < Box.mBox.mMin.y
+				||	Box.mBox.mMax.z < Current.mBox.mMin.z || Current.mBox.mMax.z < Box.mBox.mMin.z))
+			{
+				PairBuffer[NbBuffered*2+0] = Box.mId;
+				PairBuffer[NbBuffered*2+1] = Current.mId;
+				if(++NbBuffered==kPairBufferSize)
+				{
+					Status &= fwrite(PairBuffer, sizeof(udword)*2*NbBuffered, 1, PairFile)==1;
+					NbPairs += NbBuffered;
+					NbBuffered = 0;
+				}
+			}
+			j++;
+		}
+
+		// Add the current box to the active window
+		if(NbActive==MaxNbActive)
+		{
+			MaxNbActive = MaxNbActive ? MaxNbActive*2 : 1024;
+			StreamedBox* NewBoxes = new StreamedBox[MaxNbActive];
+			if(ActiveBoxes)
+			{
+				CopyMemory(NewBoxes, ActiveBoxes, NbActive*sizeof(StreamedBox));
+				DELETEARRAY(ActiveBoxes);
+			}
+			ActiveBoxes = NewBoxes;
+		}
+		ActiveBoxes[NbActive++] = Current;
+	}
+
+	Status &= !Merger.HasError();
+	if(NbBuffered)
+	{
+		Status &= fwrite(PairBuffer, sizeof(udword)*2*NbBuffered, 1, PairFile)==1;
+		NbPairs += NbBuffered;
+	}
+	Status &= fclose(PairFile)==0;
+
+	DELETEARRAY(PairBuffer);
+	DELETEARRAY(ActiveBoxes);
+	Merger.Release();
+	DELETEARRAY(RunSizes);
+	DeleteRuns(RunPrefix, NbCreated);
+
+	if(nb_pairs)
+		*nb_pairs = NbPairs;
+	return Status;
+}
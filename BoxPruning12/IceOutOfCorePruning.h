@@ -0,0 +1,18 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+ *	Contains code for the "box pruning revisited" project.
+ *	\file		IceOutOfCorePruning.h
+ *	\author		Pierre Terdiman
+ *	\date		February 2017
+ */
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Include Guard
+#ifndef ICEOUTOFCOREPRUNING_H
+#define ICEOUTOFCOREPRUNING_H
+
+	// Streaming box pruning for box files larger than memory. Pairs are written to a file.
+	FUNCTION MESHMERIZER_API bool OutOfCoreBoxPruning(const char* box_filename, const char* pair_filename, const char* temp_path, udword max_nb_boxes, uqword* nb_pairs);
+
+#endif // ICEOUTOFCOREPRUNING_H
@@ -0,0 +1,138 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+ *	Contains the pair output buffer shared by the pruning kernels.
+ *	\file		IcePairOutputBuffer.h
+ *	\author		Pierre Terdiman
+ *	\date		February 2017
+ */
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Include Guard
+#ifndef ICEPAIROUTPUTBUFFER_H
+#define ICEPAIROUTPUTBUFFER_H
+
+// Pair output buffer. We use this instead of a Container because we want slightly different
+// insertion semantics. No real abstraction in here; seeing as the whole point of this is to
+// (eventually) poke around in these fields from ASM code, it seems pointless.
+//
+// While the PairOutputBuffer is active, it takes over management of the storage for the
+// underlying Container. On destruction, it returns the storage back to the container.
+//
+// If a flush callback is set, the storage is never grown: when it fills up, the pairs below
+// the high watermark are passed to the callback and the buffer starts over from the beginning.
+// Pages always hold exactly (mHighWatermark - mBegin)/2 pairs, except for the last one.
+struct PairOutputBuffer
+{
+	static const size_t kSlack = 16; // distance from the high watermark to the actual capacity
+
+	udword*	mEnd;			// Pointer to current end (just past last inserted element)
+	udword* mHighWatermark;	// Pointer to kSlack elements before the end of the allocated storage
+	udword* mBegin;			// Pointer to beginning of storage
+	Container &mHost;		// The container we're outputting to.
+	PairFlushCallback mFlush;	// Called instead of growing the storage, if not null
+	void*	mUserData;		// Passed to the flush callback
+	bool	mFlushFailed;	// True if the flush callback reported a failure. Pairs are discarded from then on.
+
+	inline_	PairOutputBuffer(Container &host);
+	inline_	~PairOutputBuffer();
+};
+
+inline_ PairOutputBuffer::PairOutputBuffer(Container &host)
+	: mHost(host), mFlush(null), mUserData(null), mFlushFailed(false)
+{
+	if (mHost.GetCapacity() < kSlack)
+		mHost.Resize(kSlack);
+
+	mBegin = host.GetEntries();
+	mEnd = mBegin + host.GetNbEntries();
+	mHighWatermark = mBegin + host.GetCapacity() - kSlack;
+}
+
+inline_ PairOutputBuffer::~PairOutputBuffer()
+{
+	// Return storage back to the container.
+	mHost.mEntries = mBegin;
+	mHost.mCurNbEntries = mEnd - mBegin;
+	mHost.mMaxNbEntries = (mHighWatermark + kSlack) - mBegin;
+}
+
+// Passes the buffered pairs to the flush callback, one full page at a time. The remaining pairs are moved back to the
+// beginning of the buffer, or passed to the callback as well if 'all' is true.
+static void FlushPairOutputBuffer(PairOutputBuffer &buf, bool all)
+{
+	const udword PageSize = udword(buf.mHighWatermark - buf.mBegin)/2;
+	const udword* Pairs = buf.mBegin;
+	udword NbPairs = udword(buf.mEnd - buf.mBegin)/2;
+	while(NbPairs>=PageSize || (all && NbPairs))
+	{
+		const udword NbToFlush = TMin(NbPairs, PageSize);
+		if(!buf.mFlushFailed && !(buf.mFlush)(Pairs, NbToFlush, buf.mUserData))
+			buf.mFlushFailed = true;
+		Pairs += NbToFlush*2;
+		NbPairs -= NbToFlush;
+	}
+	MoveMemory(buf.mBegin, Pairs, NbPairs*2*sizeof(udword));
+	buf.mEnd = buf.mBegin + NbPairs*2;
+}
+
+static void __stdcall GrowPairOutputBuffer(PairOutputBuffer &buf)
+{
+	if(buf.mFlush)
+	{
+		FlushPairOutputBuffer(buf, false);
+		return;
+	}
+
+	size_t numEntries = buf.mEnd - buf.mBegin;
+	size_t newCapacity = numEntries * 2 + 2*PairOutputBuffer::kSlack;
+
+	udword* NewEntries = new udword[newCapacity];
+	CopyMemory(NewEntries, buf.mBegin, numEntries*sizeof(udword));
+	DELETEARRAY(buf.mBegin);
+
+	buf.mBegin = NewEntries;
+	buf.mEnd = buf.mBegin + numEntries;
+	buf.mHighWatermark = buf.mBegin + newCapacity - PairOutputBuffer::kSlack;
+}
+
+// Count trailing zeroes
+static inline udword Ctz32(udword x)
+{
+	unsigned long idx;
+	_BitScanForward(&idx, x);
+	return idx;
+}
+
+// Reports a single intersection. For the scalar (non-kernel) pruners.
+static __forceinline void ReportIntersection(PairOutputBuffer& POB, udword id0, udword id1)
+{
+	// Make sure there's enough space to insert our new elements
+	if (POB.mEnd > POB.mHighWatermark)
+		GrowPairOutputBuffer(POB);
+
+	POB.mEnd[0] = id0;
+	POB.mEnd[1] = id1;
+	POB.mEnd += 2;
+}
+
+// Reports a bunch of intersections as specified by a base index and a bit mask.
+static void __stdcall ReportIntersections(PairOutputBuffer& POB, udword remap_id0, const udword* remap_base, udword mask)
+{
+	// Make sure there's enough space to insert our new elements
+	if (POB.mEnd > POB.mHighWatermark)
+		GrowPairOutputBuffer(POB);
+
+	udword *Pairs = POB.mEnd;
+
+	do
+	{
+		*Pairs++ = remap_id0;
+		*Pairs++ = remap_base[Ctz32(mask)];
+		mask &= mask - 1;
+	} while (mask);
+
+	POB.mEnd = Pairs;
+}
+
+#endif // ICEPAIROUTPUTBUFFER_H
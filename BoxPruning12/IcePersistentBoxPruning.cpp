@@ -0,0 +1,452 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+ *	Contains code for the "box pruning revisited" project.
+ *	\file		IcePersistentBoxPruning.cpp
+ *	\author		Pierre Terdiman
+ *	\date		February 2017
+ */
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Precompiled Header
+#include "Stdafx.h"
+#include "IceFatBox.h"
+
+using namespace Meshmerizer;
+
+// Lexicographic order on (id0, id1)
+static inline_ bool PairLess(const udword* a, const udword* b)
+{
+	return a[0]<b[0] || (a[0]==b[0] && a[1]<b[1]);
+}
+
+// Above 1 stale object out of kCompleteUpdateRatio, a complete box pruning is cheaper than the incremental update
+static const udword kCompleteUpdateRatio = 4;
+
+// Compares two sorted lists of pairs. Pairs only in the new list go to created, pairs only in the old list go to deleted.
+static void DiffPairs(const udword* new_pairs, udword nb_new, const udword* old_pairs, udword nb_old, Container& created, Container& deleted)
+{
+	udword i=0, j=0;
+	while(i<nb_new || j<nb_old)
+	{
+		const udword* NewPair = i<nb_new ? new_pairs + i*2 : null;
+		const udword* OldPair = j<nb_old ? old_pairs + j*2 : null;
+		if(NewPair && (!OldPair || PairLess(NewPair, OldPair)))
+		{
+			created.Add(NewPair[0]).Add(NewPair[1]);
+			i++;
+		}
+		else if(OldPair && (!NewPair || PairLess(OldPair, NewPair)))
+		{
+			deleted.Add(OldPair[0]).Add(OldPair[1]);
+			j++;
+		}
+		else
+		{
+			i++;
+			j++;
+		}
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+ *	Constructor.
+ */
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+PersistentBoxPruning::PersistentBoxPruning() :
+	mBoxes(null), mHandles(null), mSlots(null), mStaleFlags(null), mSortedHandles(null), mSortedMinX(null), mNbSorted(0), mNbObjects(0), mMaxNbObjects(0),
+	mNbHandles(0), mFreeHandle(INVALID_ID), mMargin(0.1f), mMaxExtentX(0.0f)
+{
+	mSorter.SetMode(RADIX_AUTO);
+	mPairSorter.SetMode(RADIX_AUTO);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+ *	Destructor.
+ */
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+PersistentBoxPruning::~PersistentBoxPruning()
+{
+	DELETEARRAY(mSortedMinX);
+	DELETEARRAY(mSortedHandles);
+	DELETEARRAY(mStaleFlags);
+	DELETEARRAY(mSlots);
+	DELETEARRAY(mHandles);
+	DELETEARRAY(mBoxes);
+}
+
+void PersistentBoxPruning::Resize(udword nb)
+{
+	AABB* NewBoxes = new AABB[nb];
+	udword* NewHandles = new udword[nb];
+	udword* NewSlots = new udword[nb];
+	ubyte* NewStaleFlags = new ubyte[nb];
+	udword* NewSortedHandles = new udword[nb];
+	float* NewSortedMinX = new float[nb];
+	if(mMaxNbObjects)
+	{
+		CopyMemory(NewBoxes, mBoxes, mNbObjects*sizeof(AABB));
+		CopyMemory(NewHandles, mHandles, mNbObjects*sizeof(udword));
+		CopyMemory(NewSlots, mSlots, mNbHandles*sizeof(udword));
+		CopyMemory(NewStaleFlags, mStaleFlags, mNbHandles*sizeof(ubyte));
+		CopyMemory(NewSortedHandles, mSortedHandles, mNbSorted*sizeof(udword));
+		CopyMemory(NewSortedMinX, mSortedMinX, mNbSorted*sizeof(float));
+	}
+	DELETEARRAY(mSortedMinX);
+	DELETEARRAY(mSortedHandles);
+	DELETEARRAY(mStaleFlags);
+	DELETEARRAY(mSlots);
+	DELETEARRAY(mHandles);
+	DELETEARRAY(mBoxes);
+	mBoxes = NewBoxes;
+	mHandles = NewHandles;
+	mSlots = NewSlots;
+	mStaleFlags = NewStaleFlags;
+	mSortedHandles = NewSortedHandles;
+	mSortedMinX = NewSortedMinX;
+	mMaxNbObjects = nb;
+}
+
+// Records an object for the next Update() call, once
+void PersistentBoxPruning::MarkStale(udword handle)
+{
+	if(!mStaleFlags[handle])
+	{
+		mStaleFlags[handle] = 1;
+		mStale.Add(handle);
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+ *	Adds an object.
+ *	\param		box		[in] the object's tight box
+ *	\return		handle of the new object, reported in the pairs
+ */
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+udword PersistentBoxPruning::AddObject(const AABB& box)
+{
+	// Handles are never more numerous than objects + removed objects, which the arrays are sized for
+	udword Handle;
+	if(mFreeHandle!=INVALID_ID)
+	{
+		Handle = mFreeHandle;
+		mFreeHandle = mSlots[Handle];
+	}
+	else
+	{
+		if(mNbHandles==mMaxNbObjects)
+			Resize(mMaxNbObjects ? mMaxNbObjects*2 : 64);
+		Handle = mNbHandles++;
+		mStaleFlags[Handle] = 0;
+	}
+
+	const udword Index = mNbObjects++;
+	AABB& Fat = mBoxes[Index];
+	FattenBox(Fat, box, mMargin);
+	mMaxExtentX = TMax(mMaxExtentX, Fat.mMax.x - Fat.mMin.x);
+	mHandles[Index] = Handle;
+	mSlots[Handle] = Index;
+	MarkStale(Handle);
+	return Handle;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+ *	Removes an object. Its pairs are reported as deleted by the next Update() call, and its handle isn't reused before that.
+ *	\param		handle	[in] the object's handle
+ */
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+void PersistentBoxPruning::RemoveObject(udword handle)
+{
+	// Move the last object in the hole to keep the boxes packed
+	const udword Index = mSlots[handle];
+	const udword Last = --mNbObjects;
+	if(Index!=Last)
+	{
+		mBoxes[Index] = mBoxes[Last];
+		mHandles[Index] = mHandles[Last];
+		mSlots[mHandles[Index]] = Index;
+	}
+	mSlots[handle] = INVALID_ID;
+	MarkStale(handle);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+ *	Updates an object's box. Nothing happens as long as the tight box stays within the fat box.
+ *	\param		handle	[in] the object's handle
+ *	\param		box		[in] the object's new tight box
+ *	\return		true if the fat box has been recomputed
+ */
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+bool PersistentBoxPruning::UpdateObject(udword handle, const AABB& box)
+{
+	AABB& Fat = mBoxes[mSlots[handle]];
+	if(ContainsBox(Fat, box))
+		return false;
+
+	FattenBox(Fat, box, mMargin);
+	mMaxExtentX = TMax(mMaxExtentX, Fat.mMax.x - Fat.mMin.x);
+	MarkStale(handle);
+	return true;
+}
+
+// Sorts pairs of handles with id0<id1, secondary key first. The sorted pairs are written to mSortedPairs.
+void PersistentBoxPruning::SortPairs(Container& pairs)
+{
+	mSortedPairs.Reset();
+	const udword NbPairs = pairs.GetNbEntries()/2;
+	if(!NbPairs)
+		return;
+
+	const udword* Entries = pairs.GetEntries();
+	mKeys0.Reset();
+	mKeys1.Reset();
+	for(udword i=0;i<NbPairs;i++)
+	{
+		mKeys0.Add(Entries[i*2+0]);
+		mKeys1.Add(Entries[i*2+1]);
+	}
+	mPairSorter.Sort(mKeys1.GetEntries(), NbPairs, false);
+	const udword* Sorted = mPairSorter.Sort(mKeys0.GetEntries(), NbPairs, false).GetRanks();
+	for(udword i=0;i<NbPairs;i++)
+	{
+		const udword* Pair = Entries + Sorted[i]*2;
+		mSortedPairs.Add(Pair[0]).Add(Pair[1]);
+	}
+}
+
+// Recomputes all the pairs with a complete box pruning, and the sorted list from the sorter's ranks
+void PersistentBoxPruning::CompleteUpdate(Container& created, Container& deleted)
+{
+	// 1) Recompute the pairs of fat boxes, and convert them to handles with id0<id1. Our sorter's ranks are
+	// then the order of the packed boxes along X.
+	mNewPairs.Reset();
+	mNbSorted = 0;
+	mMaxExtentX = 0.0f;
+	if(mNbObjects)
+	{
+		CompleteBoxPruningWithSorter(mNbObjects, mBoxes, mNewPairs, mSorter);
+
+		const udword* Ranks = mSorter.GetRanks();
+		for(udword i=0;i<mNbObjects;i++)
+		{
+			const udword Index = Ranks[i];
+			const AABB& Fat = mBoxes[Index];
+			mSortedHandles[i] = mHandles[Index];
+			mSortedMinX[i] = Fat.mMin.x;
+			mMaxExtentX = TMax(mMaxExtentX, Fat.mMax.x - Fat.mMin.x);
+		}
+		mNbSorted = mNbObjects;
+	}
+
+	const udword NbPairs = mNewPairs.GetNbEntries()/2;
+	udword* Entries = mNewPairs.GetEntries();
+	for(udword i=0;i<NbPairs;i++)
+	{
+		udword id0 = mHandles[Entries[i*2+0]];
+		udword id1 = mHandles[Entries[i*2+1]];
+		if(id1<id0)
+			TSwap(id0, id1);
+		Entries[i*2+0] = id0;
+		Entries[i*2+1] = id1;
+	}
+
+	// 2) Sort them, and compare with the previous pairs
+	SortPairs(mNewPairs);
+	DiffPairs(mSortedPairs.GetEntries(), mSortedPairs.GetNbEntries()/2, mPairs.GetEntries(), mPairs.GetNbEntries()/2, created, deleted);
+
+	mPairs.Reset();
+	if(mSortedPairs.GetNbEntries())
+		mPairs.Add(mSortedPairs.GetEntries(), mSortedPairs.GetNbEntries());
+}
+
+// Only updates the stale objects: removes them from the sorted list, reinserts the live ones, sweeps them against the list,
+// and replaces their pairs. Everything else is left untouched.
+void PersistentBoxPruning::IncrementalUpdate(Container& created, Container& deleted)
+{
+	// 1) Remove the stale objects from the sorted list
+	udword NbSorted = 0;
+	for(udword i=0;i<mNbSorted;i++)
+	{
+		const udword Handle = mSortedHandles[i];
+		if(!mStaleFlags[Handle])
+		{
+			mSortedHandles[NbSorted] = Handle;
+			mSortedMinX[NbSorted] = mSortedMinX[i];
+			NbSorted++;
+		}
+	}
+
+	// 2) Sort the live ones, and merge them in, from the end so that it can be done in place
+	mMoved.Reset();
+	mMovedMinX.Reset();
+	const udword NbStale = mStale.GetNbEntries();
+	for(udword i=0;i<NbStale;i++)
+	{
+		const udword Handle = mStale.GetEntry(i);
+		if(mSlots[Handle]!=INVALID_ID)
+		{
+			mMoved.Add(Handle);
+			mMovedMinX.Add(mBoxes[mSlots[Handle]].mMin.x);
+		}
+	}
+
+	const udword NbMoved = mMoved.GetNbEntries();
+	if(NbMoved)
+	{
+		const float* MovedMinX = (const float*)mMovedMinX.GetEntries();
+		const udword* Sorted = mPairSorter.Sort(MovedMinX, NbMoved).GetRanks();
+
+		sdword i = sdword(NbSorted) - 1;
+		sdword j = sdword(NbMoved) - 1;
+		sdword k = sdword(NbSorted + NbMoved) - 1;
+		while(j>=0)
+		{
+			const udword Moved = Sorted[j];
+			if(i>=0 && mSortedMinX[i]>MovedMinX[Moved])
+			{
+				mSortedHandles[k] = mSortedHandles[i];
+				mSortedMinX[k] = mSortedMinX[i];
+				i--;
+			}
+			else
+			{
+				mSortedHandles[k] = mMoved.GetEntry(Moved);
+				mSortedMinX[k] = MovedMinX[Moved];
+				j--;
+			}
+			k--;
+		}
+	}
+	mNbSorted = NbSorted + NbMoved;
+
+	// 3) Sweep the live stale objects against the sorted list. Boxes starting more than mMaxExtentX before a box can't touch it.
+	// Pairs of two stale objects are found from both sides, we only keep them once.
+	mNewPairs.Reset();
+	for(udword m=0;m<NbMoved;m++)
+	{
+		const udword Handle0 = mMoved.GetEntry(m);
+		const AABB& Box0 = mBoxes[mSlots[Handle0]];
+
+		const float Limit = Box0.mMin.x - mMaxExtentX;
+		udword First = 0;
+		udword Last = mNbSorted;
+		while(First<Last)
+		{
+			const udword Middle = (First + Last)>>1;
+			if(mSortedMinX[Middle]<Limit)
+				First = Middle + 1;
+			else
+				Last = Middle;
+		}
+
+		for(udword i=First;i<mNbSorted && mSortedMinX[i]<=Box0.mMax.x;i++)
+		{
+			const udword Handle1 = mSortedHandles[i];
+			if(Handle1==Handle0 || (mStaleFlags[Handle1] && Handle1<Handle0))
+				continue;
+
+			if(Box0.Intersect(mBoxes[mSlots[Handle1]]))
+			{
+				if(Handle0<Handle1)
+					mNewPairs.Add(Handle0).Add(Handle1);
+				else
+					mNewPairs.Add(Handle1).Add(Handle0);
+			}
+		}
+	}
+	SortPairs(mNewPairs);
+
+	// 4) Remove the pairs of the stale objects, in place. What's left stays sorted.
+	mLostPairs.Reset();
+	udword* Pairs = mPairs.GetEntries();
+	const udword NbPairs = mPairs.GetNbEntries()/2;
+	udword NbKept = 0;
+	for(udword i=0;i<NbPairs;i++)
+	{
+		const udword id0 = Pairs[i*2+0];
+		const udword id1 = Pairs[i*2+1];
+		if(mStaleFlags[id0] || mStaleFlags[id1])
+		{
+			mLostPairs.Add(id0).Add(id1);
+		}
+		else
+		{
+			Pairs[NbKept*2+0] = id0;
+			Pairs[NbKept*2+1] = id1;
+			NbKept++;
+		}
+	}
+	mPairs.mCurNbEntries = NbKept*2;
+
+	// 5) Report the differences. Pairs lost and found again are persistent.
+	const udword* Found = mSortedPairs.GetEntries();
+	const udword NbFound = mSortedPairs.GetNbEntries()/2;
+	DiffPairs(Found, NbFound, mLostPairs.GetEntries(), mLostPairs.GetNbEntries()/2, created, deleted);
+
+	// 6) Merge the new pairs in, from the end so that it can be done in place
+	if(NbFound)
+	{
+		mPairs.Add(mSortedPairs.GetEntries(), NbFound*2);
+		Pairs = mPairs.GetEntries();
+
+		sdword i = sdword(NbKept) - 1;
+		sdword j = sdword(NbFound) - 1;
+		sdword k = sdword(NbKept + NbFound) - 1;
+		while(j>=0)
+		{
+			if(i>=0 && PairLess(Found + j*2, Pairs + i*2))
+			{
+				Pairs[k*2+0] = Pairs[i*2+0];
+				Pairs[k*2+1] = Pairs[i*2+1];
+				i--;
+			}
+			else
+			{
+				Pairs[k*2+0] = Found[j*2+0];
+				Pairs[k*2+1] = Found[j*2+1];
+				j--;
+			}
+			k--;
+		}
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+ *	Updates the pair set. Only objects added, removed, or having escaped their fat boxes since the last call are processed. Differences
+ *	with the previous pair set are appended to the output containers, as pairs of handles with id0<id1.
+ *	\param		created	[out] new pairs
+ *	\param		deleted	[out] lost pairs
+ *	\return		true if the pair set has been updated
+ */
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+bool PersistentBoxPruning::Update(Container& created, Container& deleted)
+{
+	const udword NbStale = mStale.GetNbEntries();
+	if(!NbStale)
+		return false;
+
+	if(!mNbSorted || NbStale*kCompleteUpdateRatio>mNbObjects)
+		CompleteUpdate(created, deleted);
+	else
+		IncrementalUpdate(created, deleted);
+
+	// Handles of removed objects can now be recycled
+	for(udword i=0;i<NbStale;i++)
+	{
+		const udword Handle = mStale.GetEntry(i);
+		mStaleFlags[Handle] = 0;
+		if(mSlots[Handle]==INVALID_ID)
+		{
+			mSlots[Handle] = mFreeHandle;
+			mFreeHandle = Handle;
+		}
+	}
+	mStale.Reset();
+	return true;
+}
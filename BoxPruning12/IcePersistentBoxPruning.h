@@ -0,0 +1,79 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+ *	Contains code for the "box pruning revisited" project.
+ *	\file		IcePersistentBoxPruning.h
+ *	\author		Pierre Terdiman
+ *	\date		February 2017
+ */
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Include Guard
+#ifndef ICEPERSISTENTBOXPRUNING_H
+#define ICEPERSISTENTBOXPRUNING_H
+
+	// Persistent broadphase. Objects are stored with a margin ("fat" boxes), and only objects whose tight box escapes its fat box, or
+	// which are added or removed, are processed by the next update. Those objects are removed from a persistent list sorted along X,
+	// reinserted at their new place, and swept against it, and only their pairs are updated. Objects jittering within their margin
+	// don't touch the sorted list or the pair set, so the pairs don't churn from one frame to the next. The first update, and updates
+	// touching a large fraction of the objects, run a complete box pruning instead, with the class's own sorter.
+	// Pairs are reported for overlapping fat boxes, so they're conservative.
+	class MESHMERIZER_API PersistentBoxPruning
+	{
+		public:
+		// Constructor/Destructor
+								PersistentBoxPruning();
+								~PersistentBoxPruning();
+
+		// Objects
+				udword			AddObject(const AABB& box);
+				void			RemoveObject(udword handle);
+				bool			UpdateObject(udword handle, const AABB& box);
+
+		// Pairs
+				bool			Update(Container& created, Container& deleted);
+
+		//! Sets the margin used to fatten the boxes. Only affects boxes (re)computed after the call.
+		inline_	void			SetMargin(float margin)					{ mMargin = margin;						}
+		inline_	float			GetMargin()						const	{ return mMargin;						}
+
+		inline_	const AABB&		GetFatBox(udword handle)		const	{ return mBoxes[mSlots[handle]];		}
+		inline_	udword			GetNbObjects()					const	{ return mNbObjects;					}
+		//! Current pairs of handles, as of the last Update() call. Sorted, with id0<id1.
+		inline_	const Container&	GetPairs()					const	{ return mPairs;						}
+
+								PREVENT_COPY(PersistentBoxPruning)
+		private:
+				AABB*			mBoxes;			//!< Fat boxes, packed
+				udword*			mHandles;		//!< Packed index => handle
+				udword*			mSlots;			//!< Handle => packed index, or next free handle
+				ubyte*			mStaleFlags;	//!< Handle => non-zero if the object is in mStale
+				udword*			mSortedHandles;	//!< Handles sorted by fat MinX, as of the last Update() call
+				float*			mSortedMinX;	//!< Fat MinX of the sorted handles
+				udword			mNbSorted;
+				udword			mNbObjects;
+				udword			mMaxNbObjects;
+				udword			mNbHandles;		//!< Number of handles ever allocated
+				udword			mFreeHandle;	//!< First free handle
+				Container		mStale;			//!< Handles added, removed or escaped since the last Update(). Removed ones are only recycled after it.
+				Container		mPairs;			//!< Current pairs of handles, sorted
+				Container		mNewPairs;
+				Container		mSortedPairs;
+				Container		mLostPairs;
+				Container		mKeys0;
+				Container		mKeys1;
+				Container		mMoved;			//!< Live stale handles, reinserted by the incremental update
+				Container		mMovedMinX;
+				PRUNING_SORTER	mSorter;		//!< Member for coherence, only used by complete updates
+				RadixSort		mPairSorter;	//!< Sorts pairs and reinserted objects
+				float			mMargin;
+				float			mMaxExtentX;	//!< Largest fat box extent along X, bounds the backward search of the sweeps. Only shrinks in complete updates.
+		// Internal methods
+				void			Resize(udword nb);
+				void			MarkStale(udword handle);
+				void			SortPairs(Container& pairs);
+				void			CompleteUpdate(Container& created, Container& deleted);
+				void			IncrementalUpdate(Container& created, Container& deleted);
+	};
+
+#endif // ICEPERSISTENTBOXPRUNING_H
@@ -0,0 +1,267 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+ *	Contains code for the "box pruning revisited" project.
+ *	\file		IceThreadPool.cpp
+ *	\author		Pierre Terdiman
+ *	\date		February 2017
+ */
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Precompiled Header
+#include "Stdafx.h"
+
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+
+using namespace Meshmerizer;
+
+// Number of jobs running on the current thread, from the pool's threads or from an external scheduler
+static __declspec(thread) udword gNbRunningJobs = 0;
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+ *	Executes the job. The job may be released by its function, so it isn't accessed afterwards.
+ */
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+void ThreadPoolJob::Run()
+{
+	const ThreadPoolFunction Function = mFunction;
+	void* UserData = mUserData;
+	gNbRunningJobs++;
+	(Function)(UserData);
+	gNbRunningJobs--;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+ *	Constructor.
+ */
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+ThreadPool::ThreadPool() : mThreads(null), mSemaphore(null), mLock(null), mHead(null), mTail(null), mNbThreads(0), mScheduler(null), mSchedulerData(null)
+{
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+ *	Destructor.
+ */
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+ThreadPool::~ThreadPool()
+{
+	Release();
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+ *	Creates the worker threads. When pinned, worker i runs on core i+1, so that core 0 is left to the calling thread.
+ *	\param		nb_threads	[in] number of worker threads, or 0 for one per core minus one (for the calling thread)
+ *	\param		pin_threads	[in] true to give each worker thread its own core
+ *	\return		true if success.
+ */
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+bool ThreadPool::Init(udword nb_threads, bool pin_threads)
+{
+	Release();
+
+	SYSTEM_INFO Info;
+	GetSystemInfo(&Info);
+	const udword NbCores = TMin(udword(Info.dwNumberOfProcessors), udword(sizeof(DWORD_PTR)*8));
+	if(!nb_threads)
+		nb_threads = NbCores>1 ? NbCores - 1 : 1;
+
+	CRITICAL_SECTION* Lock = new CRITICAL_SECTION;
+	InitializeCriticalSection(Lock);
+	mLock = Lock;
+
+	mSemaphore = CreateSemaphoreA(null, 0, 0x7fffffff, null);
+	if(!mSemaphore)
+	{
+		Release();
+		return false;
+	}
+
+	mThreads = new void*[nb_threads];
+	for(udword i=0;i<nb_threads;i++)
+	{
+		mThreads[i] = CreateThread(null, 0, WorkerThread, this, 0, null);
+		if(!mThreads[i])
+		{
+			mNbThreads = i;
+			Release();
+			return false;
+		}
+		if(pin_threads && NbCores>1)
+			SetThreadAffinityMask(mThreads[i], DWORD_PTR(1)<<((i+1)%NbCores));
+	}
+	mNbThreads = nb_threads;
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+ *	Stops and releases the worker threads. Jobs already in the queue are executed first.
+ */
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+void ThreadPool::Release()
+{
+	if(mNbThreads)
+	{
+		// Wake everybody up. Threads exit once the queue is empty.
+		ReleaseSemaphore(mSemaphore, mNbThreads, null);
+		// WaitForMultipleObjects is limited to MAXIMUM_WAIT_OBJECTS handles, so wait in chunks.
+		for(udword i=0;i<mNbThreads;i+=MAXIMUM_WAIT_OBJECTS)
+			WaitForMultipleObjects(TMin(mNbThreads-i, udword(MAXIMUM_WAIT_OBJECTS)), mThreads+i, TRUE, INFINITE);
+		for(udword i=0;i<mNbThreads;i++)
+			CloseHandle(mThreads[i]);
+		mNbThreads = 0;
+	}
+	DELETEARRAY(mThreads);
+
+	if(mSemaphore)
+	{
+		CloseHandle(mSemaphore);
+		mSemaphore = null;
+	}
+
+	if(mLock)
+	{
+		CRITICAL_SECTION* Lock = (CRITICAL_SECTION*)mLock;
+		DeleteCriticalSection(Lock);
+		DELETESINGLE(Lock);
+		mLock = null;
+	}
+	mHead = mTail = null;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+ *	Queues a job. It will be executed by the first available worker thread, or passed to the external scheduler if there is one.
+ *	\param		job		[in] job to execute, must stay alive until then
+ */
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+void ThreadPool::Submit(ThreadPoolJob& job)
+{
+	job.mNext = null;
+
+	if(mScheduler)
+	{
+		(mScheduler)(job, mSchedulerData);
+		return;
+	}
+
+	EnterCriticalSection((CRITICAL_SECTION*)mLock);
+	if(mTail)
+		mTail->mNext = &job;
+	else
+		mHead = &job;
+	mTail = &job;
+	LeaveCriticalSection((CRITICAL_SECTION*)mLock);
+
+	ReleaseSemaphore(mSemaphore, 1, null);
+}
+
+// Returns the next job, or null when the pool is shutting down and the queue is empty
+ThreadPoolJob* ThreadPool::PopJob()
+{
+	EnterCriticalSection((CRITICAL_SECTION*)mLock);
+	ThreadPoolJob* Job = mHead;
+	if(Job)
+	{
+		mHead = Job->mNext;
+		if(!mHead)
+			mTail = null;
+	}
+	LeaveCriticalSection((CRITICAL_SECTION*)mLock);
+	return Job;
+}
+
+unsigned long __stdcall ThreadPool::WorkerThread(void* user_data)
+{
+	ThreadPool* Pool = (ThreadPool*)user_data;
+	while(1)
+	{
+		WaitForSingleObject(Pool->mSemaphore, INFINITE);
+
+		ThreadPoolJob* Job = Pool->PopJob();
+		if(!Job)
+			break;	// Woken up by Release()
+
+		Job->Run();
+	}
+	return 0;
+}
+
+// Shared by the asynchronous pruning functions
+static ThreadPool gBoxPruningThreadPool;
+// True if the synchronous pruning functions may use the shared pool as well
+static bool gBoxPruningParallelBuild = false;
+// Spin lock for the lazy creation of the shared pool. A plain int so that it needs no initialization of its own.
+static volatile long gBoxPruningThreadPoolLock = 0;
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+ *	Returns the shared thread pool used by the asynchronous pruning functions. Unless ConfigureBoxPruningThreadPool has been
+ *	called, it is created on first use with the default number of threads. Threads making the first call at the same time wait
+ *	for the pool to be created by one of them.
+ *	\return		the shared thread pool, or null if the threads could not be created.
+ */
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+ThreadPool* Meshmerizer::GetBoxPruningThreadPool()
+{
+	if(!gBoxPruningThreadPool.IsReady())
+	{
+		while(InterlockedCompareExchange(&gBoxPruningThreadPoolLock, 1, 0))
+			SwitchToThread();
+
+		// Check again, another thread may have created it while we were waiting
+		const bool Ready = gBoxPruningThreadPool.IsReady() || gBoxPruningThreadPool.Init(0, false);
+
+		InterlockedExchange(&gBoxPruningThreadPoolLock, 0);
+		if(!Ready)
+			return null;
+	}
+	return &gBoxPruningThreadPool;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+ *	Sets up the shared thread pool used by the asynchronous pruning functions. With an external scheduler, the pool's own threads
+ *	are released and all the jobs go to the scheduler. Otherwise the threads are (re)created. Must not be called while pruning
+ *	jobs are in flight.
+ *	\param		nb_threads	[in] number of worker threads, or 0 for one per core minus one. Ignored with a scheduler.
+ *	\param		pin_threads	[in] true to give each worker thread its own core. Ignored with a scheduler.
+ *	\param		scheduler	[in] external scheduler, or null to use the pool's threads
+ *	\param		user_data		[in] user-defined data passed to the scheduler
+ *	\param		parallel_build	[in] true to let CompleteBoxPruning & co split their SoA build across the pool, and PipelinedBoxPruning
+ *							prepare the next snapshot on it. Off by default.
+ *	\return		true if success.
+ */
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+bool Meshmerizer::ConfigureBoxPruningThreadPool(udword nb_threads, bool pin_threads, ThreadPoolScheduler scheduler, void* user_data, bool parallel_build)
+{
+	gBoxPruningParallelBuild = parallel_build;
+	gBoxPruningThreadPool.SetExternalScheduler(scheduler, user_data);
+	if(scheduler)
+	{
+		gBoxPruningThreadPool.Release();
+		return true;
+	}
+	return gBoxPruningThreadPool.Init(nb_threads, pin_threads);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+ *	Returns the shared thread pool for the synchronous pruning functions, which split some of their work across it and wait for it.
+ *	This is only enabled with ConfigureBoxPruningThreadPool's parallel_build, and never from inside a pool job: the job would wait
+ *	for jobs queued behind it, which is a deadlock with a single worker thread, or with a scheduler running jobs in order.
+ *	\return		the shared thread pool, or null if the work should be done on the calling thread.
+ */
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+ThreadPool* Meshmerizer::GetBoxPruningHelperPool()
+{
+	if(!gBoxPruningParallelBuild || gNbRunningJobs)
+		return null;
+	return GetBoxPruningThreadPool();
+}
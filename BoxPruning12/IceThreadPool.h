@@ -0,0 +1,78 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+ *	Contains code for the "box pruning revisited" project.
+ *	\file		IceThreadPool.h
+ *	\author		Pierre Terdiman
+ *	\date		February 2017
+ */
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Include Guard
+#ifndef ICETHREADPOOL_H
+#define ICETHREADPOOL_H
+
+	typedef void	(*ThreadPoolFunction)(void* user_data);
+
+	struct ThreadPoolJob;
+	//! External scheduler hook. Receives the jobs instead of the pool's threads, and must eventually call job.Run() exactly once.
+	typedef void	(*ThreadPoolScheduler)(ThreadPoolJob& job, void* user_data);
+
+	// A job for the thread pool. The job is owned by the caller and must stay alive until it has been executed.
+	struct MESHMERIZER_API ThreadPoolJob
+	{
+		inline_		ThreadPoolJob() : mFunction(null), mUserData(null), mNext(null)	{}
+
+				void	Run();
+
+		ThreadPoolFunction	mFunction;
+		void*				mUserData;
+		ThreadPoolJob*		mNext;		//!< Job queue, used by the pool
+	};
+
+	// Minimal thread pool: a FIFO of jobs, consumed by a fixed number of worker threads. Alternatively the jobs can be forwarded
+	// to an external scheduler, e.g. the engine's job system, in which case the pool doesn't need threads of its own.
+	class MESHMERIZER_API ThreadPool
+	{
+		public:
+		// Constructor/Destructor
+								ThreadPool();
+								~ThreadPool();
+
+				bool			Init(udword nb_threads, bool pin_threads);
+				void			Release();
+
+				void			Submit(ThreadPoolJob& job);
+
+		inline_	void			SetExternalScheduler(ThreadPoolScheduler scheduler, void* user_data)	{ mScheduler = scheduler; mSchedulerData = user_data;	}
+		inline_	ThreadPoolScheduler	GetExternalScheduler()	const	{ return mScheduler;					}
+
+		inline_	udword			GetNbThreads()	const	{ return mNbThreads;					}
+		//! Checks whether submitted jobs will be executed
+		inline_	bool			IsReady()		const	{ return mNbThreads || mScheduler;		}
+
+								PREVENT_COPY(ThreadPool)
+		private:
+				void**			mThreads;		//!< Thread handles
+				void*			mSemaphore;		//!< Counts the queued jobs
+				void*			mLock;			//!< Critical section protecting the queue
+				ThreadPoolJob*	mHead;
+				ThreadPoolJob*	mTail;
+				udword			mNbThreads;
+				ThreadPoolScheduler	mScheduler;
+				void*			mSchedulerData;
+
+				ThreadPoolJob*	PopJob();
+		static	unsigned long __stdcall	WorkerThread(void* user_data);
+	};
+
+	// Returns the shared thread pool used by the asynchronous pruning functions. It is created on first use, from the calling thread.
+	FUNCTION MESHMERIZER_API ThreadPool* GetBoxPruningThreadPool();
+	// Sets up the shared thread pool, either with its own threads or with an external scheduler. Call before using the pool.
+	// With parallel_build, the synchronous pruning functions also use the pool to build their box arrays, and PipelinedBoxPruning
+	// to prepare the next snapshot.
+	FUNCTION MESHMERIZER_API bool ConfigureBoxPruningThreadPool(udword nb_threads, bool pin_threads, ThreadPoolScheduler scheduler, void* user_data, bool parallel_build);
+	// Returns the shared thread pool if the synchronous pruning functions may use it, null otherwise.
+	FUNCTION MESHMERIZER_API ThreadPool* GetBoxPruningHelperPool();
+
+#endif // ICETHREADPOOL_H
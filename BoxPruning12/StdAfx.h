@@ -12,12 +12,29 @@
 
 #include "..\Shared\StdAfx.h"
 
+// Only this project builds IceAdaptiveSort.cpp
+namespace IceCore
+{
+	#include "..\Shared\IceAdaptiveSort.h"
+}
+
 #define USE_HARDCODED_AXES
 #define USE_DIRECT_BOUNDS
+// Also check the other entry points of this project against brute force, see BoxPruning.cpp
+#define USE_EXTENDED_VALIDITY_TESTS
+// Also compare AdaptiveSort and RadixSort on coherent frames, see BoxPruning.cpp
+#define USE_COHERENT_SORT_TEST
 
 namespace Meshmerizer
 {
+	#include "IceThreadPool.h"
 	#include "IceBoxPruning.h"
+	#include "IceGridPruning.h"
+	#include "IceDynamicTree.h"
+	#include "IceMorton.h"
+	#include "IcePersistentBoxPruning.h"
+	#include "IceBoxFile.h"
+	#include "IceOutOfCorePruning.h"
 }
 using namespace Meshmerizer;
 
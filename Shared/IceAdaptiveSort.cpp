@@ -0,0 +1,373 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+ *	Contains an adaptive rank sorter for nearly sorted inputs.
+ *	\file		IceAdaptiveSort.cpp
+ *	\author		Pierre Terdiman
+ *	\date		February 2017
+ */
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+ *	Adaptive sort.
+ *	All inputs are first converted to unsigned integer keys with the same order, then sorted in the previous sorted order:
+ *	- no descent: the input is sorted, the previous ranks are kept (same as RadixSort)
+ *	- a few runs: the runs are merged two by two, log2(runs) sequential passes
+ *	- a few descents: one MSD radix pass over the key range, then an insertion sort. The MSD pass moves the elements that have
+ *	  changed a lot to their bucket, so the insertion sort only fixes local disorder. The insertion sort has a budget of moves,
+ *	  in case the keys are too clustered for the MSD pass to help.
+ *	- otherwise, or if the budget is exceeded: a full radix sort
+ *	All paths are stable w.r.t. the previous order.
+ *
+ *	\class		AdaptiveSort
+ *	\author		Pierre Terdiman
+ *	\version	1.0
+ *	\date		February 2017
+ */
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Precompiled Header
+#include "Stdafx.h"
+
+using namespace IceCore;
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+ *	Constructor.
+ */
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+AdaptiveSort::AdaptiveSort() :
+	mRadix			(null),
+	mRadixMode		(RADIX_8_BITS),
+	mCurrentSize	(0),
+	mNbRanks		(0),
+	mRanks			(null),
+	mRanks2			(null),
+	mKeys			(null),
+	mSortedKeys		(null),
+	mSortedKeys2	(null),
+	mTotalCalls		(0),
+	mNbHits			(0),
+	mLastPath		(ADAPTIVE_SORTED)
+{
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+ *	Destructor.
+ */
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+AdaptiveSort::~AdaptiveSort()
+{
+	DELETEARRAY(mSortedKeys2);
+	DELETEARRAY(mSortedKeys);
+	DELETEARRAY(mKeys);
+	DELETEARRAY(mRanks2);
+	DELETEARRAY(mRanks);
+	DELETESINGLE(mRadix);
+}
+
+void AdaptiveSort::CheckResize(udword nb)
+{
+	// Previous ranks are only valid for the same number of values
+	if(nb!=mNbRanks)
+		mNbRanks = 0;
+
+	if(nb>mCurrentSize)
+	{
+		DELETEARRAY(mSortedKeys2);
+		DELETEARRAY(mSortedKeys);
+		DELETEARRAY(mKeys);
+		DELETEARRAY(mRanks2);
+		DELETEARRAY(mRanks);
+		// Same slack as RadixSort, the pruning code reads the ranks 4 at a time
+		mRanks			= new udword[nb+RADIX_RANKS_SLACK];
+		mRanks2			= new udword[nb+RADIX_RANKS_SLACK];
+		ZeroMemory(mRanks+nb, RADIX_RANKS_SLACK*sizeof(udword));
+		ZeroMemory(mRanks2+nb, RADIX_RANKS_SLACK*sizeof(udword));
+		mKeys			= new udword[nb];
+		mSortedKeys		= new udword[nb];
+		mSortedKeys2	= new udword[nb];
+		mCurrentSize	= nb;
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+ *	Main sort routine, for integer values. After the call, mRanks contains a list of indices in sorted order.
+ *	\param		input			[in] a list of integer values to sort
+ *	\param		nb				[in] number of values to sort, must be < 2^31
+ *	\param		signedvalues	[in] true to handle negative values, false if you know your input buffer only contains positive values
+ *	\return		Self-Reference
+ */
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+AdaptiveSort& AdaptiveSort::Sort(const udword* input, udword nb, bool signedvalues)
+{
+	// Checkings
+	if(!input || !nb || nb&0x80000000)	return *this;
+
+	CheckResize(nb);
+
+	// Flipping the sign bit gives the unsigned order of signed values
+	const udword Toggle = signedvalues ? 0x80000000 : 0;
+	for(udword i=0;i<nb;i++)	mKeys[i] = input[i] ^ Toggle;
+
+	return SortKeys(nb);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+ *	Main sort routine, for floating-point values. After the call, mRanks contains a list of indices in sorted order.
+ *	\param		input			[in] a list of floating-point values to sort
+ *	\param		nb				[in] number of values to sort, must be < 2^31
+ *	\return		Self-Reference
+ *	\warning	only sorts IEEE floating-point values
+ */
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+AdaptiveSort& AdaptiveSort::Sort(const float* input, udword nb)
+{
+	return Sort(input, nb, sizeof(float));
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+ *	Main sort routine, for floating-point values read with a stride, e.g. one coordinate of an array of structures.
+ *	\param		input			[in] address of the first value to sort
+ *	\param		nb				[in] number of values to sort, must be < 2^31
+ *	\param		stride			[in] number of bytes between two values
+ *	\return		Self-Reference
+ *	\warning	only sorts IEEE floating-point values
+ */
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+AdaptiveSort& AdaptiveSort::Sort(const float* input, udword nb, udword stride)
+{
+	// Checkings
+	if(!input || !nb || nb&0x80000000)	return *this;
+
+	CheckResize(nb);
+
+	// Same keys as RadixSort's strided version: -0.0 => +0.0, then negative values get all their bits flipped, positive ones their sign bit
+	const ubyte* Base = (const ubyte*)input;
+	for(udword i=0;i<nb;i++)
+	{
+		udword Bits = *(const udword*)(Base + size_t(i)*stride);
+		if(Bits==0x80000000)	Bits = 0;
+		mKeys[i] = Bits ^ (udword(sdword(Bits)>>31) | 0x80000000);
+	}
+
+	return SortKeys(nb);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+ *	Sorts the integer keys from mKeys, starting from the previous sorted order.
+ *	\param		nb				[in] number of keys
+ *	\return		Self-Reference
+ */
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+AdaptiveSort& AdaptiveSort::SortKeys(udword nb)
+{
+	// Stats
+	mTotalCalls++;
+
+	// Start from the identity if we don't have valid ranks
+	if(!mNbRanks)
+	{
+		for(udword i=0;i<nb;i++)	mRanks[i] = i;
+		mNbRanks = nb;
+	}
+
+	// Read the keys in the previous sorted order, and measure how far from sorted they are. Runs are recorded as long as they're few.
+	// We stop as soon as there are too many descents for the other paths, the radix sort doesn't need any of this.
+	udword RunStarts[ADAPTIVE_MAX_RUNS+1];
+	RunStarts[0] = 0;
+	const udword MaxNbDescents = TMax(nb/ADAPTIVE_DESCENT_RATIO, udword(ADAPTIVE_MAX_RUNS));
+	udword NbDescents = 0;
+	udword MinKey = 0xffffffff;
+	udword MaxKey = 0;
+	udword PrevKey = 0;
+	for(udword i=0;i<nb;i++)
+	{
+		const udword Key = mKeys[mRanks[i]];
+		mSortedKeys[i] = Key;
+		if(Key<PrevKey)
+		{
+			if(NbDescents<ADAPTIVE_MAX_RUNS)	RunStarts[NbDescents+1] = i;
+			if(++NbDescents>MaxNbDescents)
+				break;
+		}
+		PrevKey = Key;
+		MinKey = TMin(MinKey, Key);
+		MaxKey = TMax(MaxKey, Key);
+	}
+
+	if(!NbDescents)
+	{
+		// Already sorted, leave the previous list unchanged
+		mNbHits++;
+		mLastPath = ADAPTIVE_SORTED;
+	}
+	else if(NbDescents<ADAPTIVE_MAX_RUNS)
+	{
+		MergeRuns(nb, NbDescents+1, RunStarts);
+		mLastPath = ADAPTIVE_MERGE;
+	}
+	else if(NbDescents<=MaxNbDescents && InsertionSort(nb, MinKey, MaxKey))
+	{
+		mLastPath = ADAPTIVE_INSERTION;
+	}
+	else
+	{
+		RadixSortKeys(nb);
+		mLastPath = ADAPTIVE_RADIX;
+	}
+	return *this;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+ *	Merges the natural runs of mSortedKeys two by two, until there's only one left. Ranks are moved along.
+ *	\param		nb				[in] number of keys
+ *	\param		nb_runs			[in] number of runs, at least 2
+ *	\param		run_starts		[in] start of each run, trashed
+ */
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+void AdaptiveSort::MergeRuns(udword nb, udword nb_runs, udword* run_starts)
+{
+	while(nb_runs>1)
+	{
+		udword NbMergedRuns = 0;
+		for(udword r=0;r<nb_runs;r+=2)
+		{
+			const udword Start = run_starts[r];
+			const udword Middle = r+1<nb_runs ? run_starts[r+1] : nb;
+			const udword End = r+2<nb_runs ? run_starts[r+2] : nb;
+
+			// Take from the left run on ties, for stability
+			udword i = Start;
+			udword j = Middle;
+			udword k = Start;
+			while(i<Middle && j<End)
+			{
+				if(mSortedKeys[j]<mSortedKeys[i])	{ mSortedKeys2[k] = mSortedKeys[j];	mRanks2[k++] = mRanks[j++];	}
+				else								{ mSortedKeys2[k] = mSortedKeys[i];	mRanks2[k++] = mRanks[i++];	}
+			}
+			while(i<Middle)	{ mSortedKeys2[k] = mSortedKeys[i];	mRanks2[k++] = mRanks[i++];	}
+			while(j<End)	{ mSortedKeys2[k] = mSortedKeys[j];	mRanks2[k++] = mRanks[j++];	}
+
+			run_starts[NbMergedRuns++] = Start;
+		}
+		nb_runs = NbMergedRuns;
+
+		// Swap pointers for next pass
+		udword* Tmp = mRanks;		mRanks = mRanks2;				mRanks2 = Tmp;
+		Tmp = mSortedKeys;			mSortedKeys = mSortedKeys2;		mSortedKeys2 = Tmp;
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+ *	Sorts mSortedKeys with an MSD radix pass over the key range, then an insertion sort. Ranks are moved along.
+ *	The MSD pass is stable, and keys never cross bucket boundaries afterwards, so a single insertion sort over the whole list
+ *	only sorts each bucket.
+ *	\param		nb				[in] number of keys
+ *	\param		min_key			[in] smallest key
+ *	\param		max_key			[in] largest key
+ *	\return		true if success, false if the insertion sort ran out of budget. mRanks is then left unchanged.
+ */
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+bool AdaptiveSort::InsertionSort(udword nb, udword min_key, udword max_key)
+{
+	// Digit = most significant bits of the key relative to the smallest one
+	const udword Range = max_key - min_key;
+	udword NbSignificantBits = 1;
+	while(NbSignificantBits<32 && (Range>>NbSignificantBits))	NbSignificantBits++;
+	const udword NbBits = TMin(NbSignificantBits, udword(ADAPTIVE_MSD_BITS));
+	const udword Shift = NbSignificantBits - NbBits;
+	const udword NbDigits = 1<<NbBits;
+
+	// MSD pass
+	udword Offsets[1<<ADAPTIVE_MSD_BITS];
+	ZeroMemory(Offsets, NbDigits*sizeof(udword));
+	for(udword i=0;i<nb;i++)	Offsets[(mSortedKeys[i]-min_key)>>Shift]++;
+
+	udword Sum = 0;
+	for(udword i=0;i<NbDigits;i++)
+	{
+		const udword Count = Offsets[i];
+		Offsets[i] = Sum;
+		Sum += Count;
+	}
+
+	for(udword i=0;i<nb;i++)
+	{
+		const udword Key = mSortedKeys[i];
+		const udword Pos = Offsets[(Key-min_key)>>Shift]++;
+		mSortedKeys2[Pos] = Key;
+		mRanks2[Pos] = mRanks[i];
+	}
+
+	// Insertion sort, stable since we only move past strictly greater keys
+	const uqword Budget = uqword(nb)*ADAPTIVE_INSERTION_BUDGET;
+	uqword NbMoves = 0;
+	for(udword i=1;i<nb;i++)
+	{
+		const udword Key = mSortedKeys2[i];
+		if(Key>=mSortedKeys2[i-1])
+			continue;
+
+		const udword Rank = mRanks2[i];
+		udword j = i;
+		do
+		{
+			mSortedKeys2[j] = mSortedKeys2[j-1];
+			mRanks2[j] = mRanks2[j-1];
+			j--;
+		}while(j && mSortedKeys2[j-1]>Key);
+		mSortedKeys2[j] = Key;
+		mRanks2[j] = Rank;
+
+		NbMoves += i - j;
+		if(NbMoves>Budget)
+			return false;
+	}
+
+	// Swap pointers
+	udword* Tmp = mRanks;		mRanks = mRanks2;				mRanks2 = Tmp;
+	Tmp = mSortedKeys;			mSortedKeys = mSortedKeys2;		mSortedKeys2 = Tmp;
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+ *	Sorts mKeys with a full radix sort, starting from the previous sorted order so that ties keep it.
+ *	\param		nb				[in] number of keys
+ */
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+void AdaptiveSort::RadixSortKeys(udword nb)
+{
+	// Coherent inputs never get here, so they don't pay for the radix sorter's histograms
+	if(!mRadix)
+		mRadix = new RadixSort;
+	mRadix->SetMode(mRadixMode);
+
+	mRadix->SetRanks(mRanks, nb);
+	CopyMemory(mRanks, mRadix->Sort(mKeys, nb, false).GetRanks(), nb*sizeof(udword));
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+ *	Gets the ram used.
+ *	\return		memory used in bytes
+ */
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+udword AdaptiveSort::GetUsedRam() const
+{
+	udword UsedRam = sizeof(AdaptiveSort);
+	if(mRadix)
+		UsedRam += mRadix->GetUsedRam();
+	UsedRam += 2*(mCurrentSize+RADIX_RANKS_SLACK)*sizeof(udword);	// 2 lists of ranks
+	UsedRam += 3*mCurrentSize*sizeof(udword);						// 3 lists of keys
+	return UsedRam;
+}
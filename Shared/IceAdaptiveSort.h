@@ -0,0 +1,92 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+ *	Contains an adaptive rank sorter for nearly sorted inputs.
+ *	\file		IceAdaptiveSort.h
+ *	\author		Pierre Terdiman
+ *	\date		February 2017
+ */
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Include Guard
+#ifndef __ICEADAPTIVESORT_H__
+#define __ICEADAPTIVESORT_H__
+
+	//! Inputs with fewer runs than this are sorted by merging the runs
+	#define ADAPTIVE_MAX_RUNS			16
+	//! Inputs with at most nb/ADAPTIVE_DESCENT_RATIO descents are sorted with an MSD pass and an insertion sort
+	#define ADAPTIVE_DESCENT_RATIO		16
+	//! The insertion sort gives up after nb*ADAPTIVE_INSERTION_BUDGET moves, and the radix sort takes over
+	#define ADAPTIVE_INSERTION_BUDGET	4
+	//! Number of bits of the MSD pass
+	#define ADAPTIVE_MSD_BITS			11
+
+	//! Code path taken by the last AdaptiveSort::Sort() call
+	enum AdaptiveSortPath
+	{
+		ADAPTIVE_SORTED,	//!< Already sorted, previous ranks kept
+		ADAPTIVE_MERGE,		//!< Few runs, merged
+		ADAPTIVE_INSERTION,	//!< Few descents, MSD pass then insertion sort
+		ADAPTIVE_RADIX,		//!< Full radix sort
+
+		ADAPTIVE_FORCE_DWORD	= 0x7fffffff
+	};
+
+	// Rank sorter with the same interface as RadixSort, for frame-coherent inputs. RadixSort only benefits from coherence when
+	// the input is exactly sorted in the previous order, which is rarely the case when things move. This one counts the descents
+	// of the input in the previous order, and picks the cheapest way to sort it: merging the natural runs when there are only a
+	// few of them, an MSD radix pass followed by an insertion sort when the input is nearly sorted, or a full radix sort.
+	// Ties keep their previous order, so multiple keys are supported the same way.
+	class ICECORE_API AdaptiveSort
+	{
+		public:
+		// Constructor/Destructor
+								AdaptiveSort();
+								~AdaptiveSort();
+		// Sorting methods
+				AdaptiveSort&	Sort(const udword* input, udword nb, bool signedvalues=true);
+				AdaptiveSort&	Sort(const float* input, udword nb);
+				AdaptiveSort&	Sort(const float* input, udword nb, udword stride);
+
+		//! Digit size selection for the full radix sort, see RadixSort::SetMode
+		inline_	void			SetMode(RadixSortMode mode)	{ mRadixMode = mode;	}
+
+		//! Access to results. mRanks is a list of indices in sorted order, i.e. in the order you may further process your data
+		inline_	udword*			GetRanks()			const	{ return mRanks;		}
+
+		//! mRanks2 gets trashed on calling the sort routine, but otherwise you can recycle it the way you want.
+		inline_	udword*			GetRecyclable()		const	{ return mRanks2;		}
+
+		// Stats
+				udword			GetUsedRam()		const;
+		//! Returns the total number of calls to the sorter.
+		inline_	udword			GetNbTotalCalls()	const	{ return mTotalCalls;	}
+		//! Returns the number of premature exits due to temporal coherence.
+		inline_	udword			GetNbHits()			const	{ return mNbHits;		}
+		//! Returns the code path taken by the last call.
+		inline_	AdaptiveSortPath	GetLastPath()	const	{ return mLastPath;		}
+
+								PREVENT_COPY(AdaptiveSort)
+		private:
+				RadixSort*		mRadix;				//!< For the full sort, created on first use
+				RadixSortMode	mRadixMode;
+				udword			mCurrentSize;		//!< Current size of the lists
+				udword			mNbRanks;			//!< Number of valid ranks, 0 if none
+				udword*			mRanks;				//!< Two lists, swapped each pass
+				udword*			mRanks2;
+				udword*			mKeys;				//!< Integer keys, in input order
+				udword*			mSortedKeys;		//!< Integer keys, in the same order as the ranks
+				udword*			mSortedKeys2;
+		// Stats
+				udword			mTotalCalls;
+				udword			mNbHits;
+				AdaptiveSortPath	mLastPath;
+		// Internal methods
+				void			CheckResize(udword nb);
+				AdaptiveSort&	SortKeys(udword nb);
+				void			MergeRuns(udword nb, udword nb_runs, udword* run_starts);
+				bool			InsertionSort(udword nb, udword min_key, udword max_key);
+				void			RadixSortKeys(udword nb);
+	};
+
+#endif // __ICEADAPTIVESORT_H__
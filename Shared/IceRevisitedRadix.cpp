@@ -28,6 +28,7 @@
  *	- 01.20.02: bugfix! In very particular cases the last pass was skipped in the float code-path, leading to incorrect sorting......
  *	- 01.02.02:	- "mIndices" renamed => "mRanks". That's a rank sorter after all.
  *				- ranks are not "reset" anymore, but implicit on first calls
+ *	- 02.xx.17: added the 11-bit, 3-pass version for large inputs
  *
  *	\class		RadixSort
  *	\author		Pierre Terdiman
@@ -40,13 +41,13 @@
 To do:
 	- add an offset parameter between two input values (avoid some data recopy sometimes)
 	- unroll ? asm ?
-	- 11 bits trick & 3 passes as Michael did
 	- prefetch stuff the day I have a P3
 */
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Precompiled Header
 #include "Stdafx.h"
+#include <emmintrin.h>
 
 using namespace IceCore;
 
@@ -138,6 +139,91 @@ using namespace IceCore;
 		h0[*p++]++;	h1[*p++]++;	h2[*p++]++;	h3[*p++]++;										\
 	}
 
+// 11-bit digits: passes 0 and 1 use 11 bits, the last pass uses the remaining 10 bits (sign included)
+#define RADIX11_SIZE		2048
+#define RADIX11_MASK		(RADIX11_SIZE-1)
+#define RADIX11_LAST_SIZE	1024
+#define RADIX11_NEGATIVE	512		// First negative digit of the last pass
+
+// Same as CREATE_HISTOGRAMS, for 11-bit digits
+#define CREATE_HISTOGRAMS11(type, buffer)													\
+	/* Clear counters/histograms */															\
+	ZeroMemory(mHistogram, RADIX11_SIZE*3*sizeof(udword));									\
+																							\
+	/* Prepare to count */																	\
+	const udword* p = input;																\
+	const udword* pe = &input[nb];															\
+	udword* h0= &mHistogram[0];					/* Histogram for first pass (LSB)	*/		\
+	udword* h1= &mHistogram[RADIX11_SIZE];		/* Histogram for second pass		*/		\
+	udword* h2= &mHistogram[RADIX11_SIZE*2];	/* Histogram for last pass (MSB)	*/		\
+																							\
+	bool AlreadySorted = true;	/* Optimism... */											\
+																							\
+	if(INVALID_RANKS)																		\
+	{																						\
+		/* Prepare for temporal coherence */												\
+		const type* Running = (const type*)buffer;											\
+		type PrevVal = *Running;															\
+																							\
+		while(p!=pe)																		\
+		{																					\
+			/* Read input buffer in previous sorted order */								\
+			type Val = *Running++;															\
+			/* Check whether already sorted or not */										\
+			if(Val<PrevVal)	{ AlreadySorted = false; break; } /* Early out */				\
+			/* Update for next iteration */													\
+			PrevVal = Val;																	\
+																							\
+			/* Create histograms */															\
+			const udword v = *p++;															\
+			h0[v&RADIX11_MASK]++;	h1[(v>>11)&RADIX11_MASK]++;	h2[v>>22]++;				\
+		}																					\
+																							\
+		if(AlreadySorted)																	\
+		{																					\
+			mNbHits++;																		\
+			for(udword i=0;i<nb;i++)	mRanks[i] = i;										\
+			return *this;																	\
+		}																					\
+	}																						\
+	else																					\
+	{																						\
+		/* Prepare for temporal coherence */												\
+		udword* Indices = mRanks;															\
+		type PrevVal = (type)buffer[*Indices];												\
+																							\
+		while(p!=pe)																		\
+		{																					\
+			/* Read input buffer in previous sorted order */								\
+			type Val = (type)buffer[*Indices++];											\
+			/* Check whether already sorted or not */										\
+			if(Val<PrevVal)	{ AlreadySorted = false; break; } /* Early out */				\
+			/* Update for next iteration */													\
+			PrevVal = Val;																	\
+																							\
+			/* Create histograms */															\
+			const udword v = *p++;															\
+			h0[v&RADIX11_MASK]++;	h1[(v>>11)&RADIX11_MASK]++;	h2[v>>22]++;				\
+		}																					\
+																							\
+		if(AlreadySorted)	{ mNbHits++; return *this;	}									\
+	}																						\
+																							\
+	/* Else there has been an early out and we must finish computing the histograms */		\
+	while(p!=pe)																			\
+	{																						\
+		const udword v = *p++;																\
+		h0[v&RADIX11_MASK]++;	h1[(v>>11)&RADIX11_MASK]++;	h2[v>>22]++;					\
+	}
+
+// Input types for the 11-bit version
+enum RadixInputType
+{
+	RADIX_UNSIGNED,
+	RADIX_SIGNED,
+	RADIX_FLOAT,
+};
+
 #define CHECK_PASS_VALIDITY(pass)															\
 	/* Shortcut to current counters */														\
 	udword* CurCount = &mHistogram[pass<<8];												\
@@ -164,12 +250,12 @@ using namespace IceCore;
  *	Constructor.
  */
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-RadixSort::RadixSort() : mRanks(null), mRanks2(null), mCurrentSize(0), mTotalCalls(0), mNbHits(0)
+RadixSort::RadixSort() : mRanks(null), mRanks2(null), mKeys(null), mKeysSize(0), mCurrentSize(0), mTotalCalls(0), mNbHits(0), mMode(RADIX_8_BITS)
 {
 #ifndef RADIX_LOCAL_RAM
-	// Allocate input-independent ram
-	mHistogram	= new udword[256*4];
-	mOffset		= new udword[256];
+	// Allocate input-independent ram. Big enough for the 11-bit version.
+	mHistogram	= new udword[RADIX11_SIZE*3];
+	mOffset		= new udword[RADIX11_SIZE];
 #endif
 	// Initialize indices
 	INVALIDATE_RANKS;
@@ -187,6 +273,7 @@ RadixSort::~RadixSort()
 	DELETEARRAY(mOffset);
 	DELETEARRAY(mHistogram);
 #endif
+	DELETEARRAY(mKeys);
 	DELETEARRAY(mRanks2);
 	DELETEARRAY(mRanks);
 }
@@ -204,9 +291,11 @@ bool RadixSort::Resize(udword nb)
 	DELETEARRAY(mRanks2);
 	DELETEARRAY(mRanks);
 
-	// Get some fresh one
-	mRanks	= new udword[nb];	CHECKALLOC(mRanks);
-	mRanks2	= new udword[nb];	CHECKALLOC(mRanks2);
+	// Get some fresh one, with some slack for SIMD reads past the last rank
+	mRanks	= new udword[nb+RADIX_RANKS_SLACK];	CHECKALLOC(mRanks);
+	mRanks2	= new udword[nb+RADIX_RANKS_SLACK];	CHECKALLOC(mRanks2);
+	ZeroMemory(mRanks+nb, RADIX_RANKS_SLACK*sizeof(udword));
+	ZeroMemory(mRanks2+nb, RADIX_RANKS_SLACK*sizeof(udword));
 
 	return true;
 }
@@ -222,6 +311,21 @@ inline_ void RadixSort::CheckResize(udword nb)
 	}
 }
 
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+ *	Sets the order the next call starts from, instead of the previous sorted order. Values that are equal keep this order, so
+ *	this is a way to sort with multiple keys when the previous keys have been sorted elsewhere.
+ *	\param		ranks			[in] a permutation of 0..nb-1
+ *	\param		nb				[in] number of values of the next call
+ */
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+void RadixSort::SetRanks(const udword* ranks, udword nb)
+{
+	CheckResize(nb);
+	CopyMemory(mRanks, ranks, nb*sizeof(udword));
+	VALIDATE_RANKS;
+}
+
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 /**
  *	Main sort routine.
@@ -243,6 +347,10 @@ RadixSort& RadixSort::Sort(const udword* input, udword nb, bool signedvalues)
 	// Resize lists if needed
 	CheckResize(nb);
 
+	// Large inputs are better off with one less pass
+	if(Use11Bits(nb))
+		return Sort11Bits(input, nb, signedvalues ? RADIX_SIGNED : RADIX_UNSIGNED);
+
 #ifdef RADIX_LOCAL_RAM
 	// Allocate histograms & offsets on the stack
 	udword mHistogram[256*4];
@@ -348,6 +456,10 @@ RadixSort& RadixSort::Sort(const float* input2, udword nb)
 	// Resize lists if needed
 	CheckResize(nb);
 
+	// Large inputs are better off with one less pass
+	if(Use11Bits(nb))
+		return Sort11Bits(input, nb, RADIX_FLOAT);
+
 #ifdef RADIX_LOCAL_RAM
 	// Allocate histograms & offsets on the stack
 	udword mHistogram[256*4];
@@ -476,6 +588,332 @@ RadixSort& RadixSort::Sort(const float* input2, udword nb)
 	return *this;
 }
 
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+ *	Main sort routine, for floating-point values read with a stride, e.g. one coordinate of an array of structures.
+ *	The floats are converted to unsigned integer keys with the same order (-0.0 and +0.0 being equal), in an internal buffer.
+ *	The conversion, the histograms and the temporal coherence test are all done in a single pass over the input, which
+ *	avoids copying the values to a temporary array first. The passes then run on the integer keys, so there's no need to
+ *	patch the offsets for negative values.
+ *	In RADIX_KEY_RANGE mode the single pass computes the range of the keys instead of the histograms. Keys are then made
+ *	relative to the smallest one, and only the significant bits are sorted, with 1 to 3 passes of up to 11 bits. This is a
+ *	win for narrow ranges, e.g. positions in a bounded world, where most high-order passes would be useless.
+ *	\param		input			[in] address of the first value to sort
+ *	\param		nb				[in] number of values to sort, must be < 2^31
+ *	\param		stride			[in] number of bytes between two values
+ *	\return		Self-Reference
+ *	\warning	only sorts IEEE floating-point values
+ */
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+RadixSort& RadixSort::Sort(const float* input, udword nb, udword stride)
+{
+	// Checkings
+	if(!input || !nb || nb&0x80000000)	return *this;
+
+	// Stats
+	mTotalCalls++;
+
+	// Resize lists if needed
+	CheckResize(nb);
+	if(nb>mKeysSize)
+	{
+		DELETEARRAY(mKeys);
+		mKeys = new udword[nb];
+		mKeysSize = nb;
+	}
+
+#ifdef RADIX_LOCAL_RAM
+	// Allocate histograms & offsets on the stack. Big enough for both digit sizes.
+	udword mHistogram[RADIX11_SIZE*3];
+	udword mOffset[RADIX11_SIZE];
+#endif
+
+	const bool KeyRange = mMode==RADIX_KEY_RANGE;
+	const bool Use11 = Use11Bits(nb);
+	udword NbBits = Use11 ? 11 : 8;
+	udword NbPasses = Use11 ? 3 : 4;
+	udword NbDigits = 1<<NbBits;
+	udword Mask = NbDigits-1;
+	if(!KeyRange)
+		ZeroMemory(mHistogram, NbDigits*NbPasses*sizeof(udword));
+	udword* h0 = &mHistogram[0];
+	udword* h1 = &mHistogram[NbDigits];
+	udword* h2 = &mHistogram[NbDigits*2];
+	udword* h3 = &mHistogram[NbDigits*3];	// Only for 8-bit digits
+
+	const ubyte* Base = (const ubyte*)input;
+	#define STRIDED_VALUE(i)	*(const float*)(Base + size_t(i)*stride)
+
+	// Single pass over the input: keys, histograms or key range, coherence. Keys are created 4 at a time.
+	const __m128i SignBit = _mm_set1_epi32(0x80000000);
+	udword MinKey = 0xffffffff;
+	udword MaxKey = 0;
+	udword* Indices = INVALID_RANKS ? null : mRanks;
+	float PrevVal = STRIDED_VALUE(Indices ? Indices[0] : 0);
+	bool AlreadySorted = true;
+	udword i=0;
+	while(i<nb)
+	{
+		if(i+4<=nb)
+		{
+			// Adding 0 canonicalizes -0.0 to +0.0. Negative values get all their bits flipped, positive ones their sign bit.
+			__m128 f = _mm_setr_ps(STRIDED_VALUE(i), STRIDED_VALUE(i+1), STRIDED_VALUE(i+2), STRIDED_VALUE(i+3));
+			f = _mm_add_ps(f, _mm_setzero_ps());
+			const __m128i Bits = _mm_castps_si128(f);
+			const __m128i Toggle = _mm_or_si128(_mm_srai_epi32(Bits, 31), SignBit);
+			_mm_storeu_si128((__m128i*)&mKeys[i], _mm_xor_si128(Bits, Toggle));
+		}
+		else
+		{
+			for(udword j=i;j<nb;j++)
+			{
+				float f = STRIDED_VALUE(j);
+				udword Bits = IR(f);
+				if(Bits==0x80000000)	Bits = 0;	// -0.0 => +0.0
+				mKeys[j] = Bits ^ (udword(sdword(Bits)>>31) | 0x80000000);
+			}
+		}
+
+		const udword End = TMin(i+4, nb);
+		for(;i<End;i++)
+		{
+			if(AlreadySorted)
+			{
+				// Read input buffer in previous sorted order, and check whether already sorted or not
+				const float Val = STRIDED_VALUE(Indices ? Indices[i] : i);
+				if(Val<PrevVal)	AlreadySorted = false;
+				PrevVal = Val;
+			}
+
+			const udword Key = mKeys[i];
+			if(KeyRange)
+			{
+				MinKey = TMin(MinKey, Key);
+				MaxKey = TMax(MaxKey, Key);
+			}
+			else
+			{
+				h0[Key&Mask]++;	h1[(Key>>NbBits)&Mask]++;	h2[(Key>>(NbBits*2))&Mask]++;
+				if(!Use11)	h3[Key>>24]++;
+			}
+		}
+	}
+	#undef STRIDED_VALUE
+
+	// Same as the other versions: leave the previous list unchanged if the input is already sorted
+	if(AlreadySorted)
+	{
+		mNbHits++;
+		if(!Indices)
+			for(udword j=0;j<nb;j++)	mRanks[j] = j;
+		return *this;
+	}
+
+	if(KeyRange)
+	{
+		// Number of significant bits of the range. At least 1, in case the range is empty (NaNs).
+		const udword Range = MaxKey - MinKey;
+		udword NbSignificantBits = 1;
+		while(NbSignificantBits<32 && (Range>>NbSignificantBits))	NbSignificantBits++;
+
+		// As few passes as possible, with digits of 11 bits at most
+		NbPasses = (NbSignificantBits+10)/11;
+		NbBits = (NbSignificantBits+NbPasses-1)/NbPasses;
+		NbDigits = 1<<NbBits;
+		Mask = NbDigits-1;
+
+		// Make the keys relative to the smallest one, and create the histograms
+		ZeroMemory(mHistogram, NbDigits*NbPasses*sizeof(udword));
+		for(udword k=0;k<nb;k++)
+		{
+			const udword Key = mKeys[k] - MinKey;
+			mKeys[k] = Key;
+			for(udword j=0;j<NbPasses;j++)
+				mHistogram[j*NbDigits + ((Key>>(j*NbBits))&Mask)]++;
+		}
+	}
+
+	// Radix sort on the integer keys, j is the pass number (0=LSB)
+	for(udword j=0;j<NbPasses;j++)
+	{
+		const udword Shift = j*NbBits;
+		udword* CurCount = &mHistogram[j*NbDigits];
+
+		// If all keys have the same digit, sorting is useless
+		if(CurCount[(mKeys[0]>>Shift)&Mask]==nb)
+			continue;
+
+		// Create offsets
+		mOffset[0] = 0;
+		for(udword k=1;k<NbDigits;k++)	mOffset[k] = mOffset[k-1] + CurCount[k-1];
+
+		// Perform Radix Sort
+		if(INVALID_RANKS)
+		{
+			for(udword k=0;k<nb;k++)	mRanks2[mOffset[(mKeys[k]>>Shift)&Mask]++] = k;
+			VALIDATE_RANKS;
+		}
+		else
+		{
+			udword* Indices		= mRanks;
+			udword* IndicesEnd	= &mRanks[nb];
+			while(Indices!=IndicesEnd)
+			{
+				udword id = *Indices++;
+				mRanks2[mOffset[(mKeys[id]>>Shift)&Mask]++] = id;
+			}
+		}
+
+		// Swap pointers for next pass. Valid indices - the most recent ones - are in mRanks after the swap.
+		udword* Tmp	= mRanks;	mRanks = mRanks2; mRanks2 = Tmp;
+	}
+	return *this;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+ *	Sort routine for 11-bit digits, i.e. 3 passes instead of 4. The 2048-entry histograms still fit in L1, and one full
+ *	scatter pass over memory is saved, which wins for large inputs. Negative values, floats and temporal coherence are handled
+ *	the same way as in the 8-bit version, the digits of the last pass being 10 bits wide (sign included).
+ *	\param		input			[in] a list of values to sort, already checked by the caller
+ *	\param		nb				[in] number of values to sort
+ *	\param		type			[in] RadixInputType
+ *	\return		Self-Reference
+ */
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+RadixSort& RadixSort::Sort11Bits(const udword* input, udword nb, udword type)
+{
+#ifdef RADIX_LOCAL_RAM
+	// Allocate histograms & offsets on the stack
+	udword mHistogram[RADIX11_SIZE*3];
+	udword mOffset[RADIX11_SIZE];
+#endif
+
+	// Create histograms, with the right comparison for temporal coherence
+	if(type==RADIX_UNSIGNED)	{ CREATE_HISTOGRAMS11(udword, input);	}
+	else if(type==RADIX_SIGNED)	{ CREATE_HISTOGRAMS11(sdword, input);	}
+	else
+	{
+		const float* FloatInput = (const float*)input;
+		CREATE_HISTOGRAMS11(float, FloatInput);
+	}
+
+	// Compute #negative values involved if needed
+	udword NbNegativeValues = 0;
+	if(type!=RADIX_UNSIGNED)
+	{
+		udword* h2 = &mHistogram[RADIX11_SIZE*2];
+		for(udword i=RADIX11_NEGATIVE;i<RADIX11_LAST_SIZE;i++)	NbNegativeValues += h2[i];
+	}
+
+	// Radix sort, j is the pass number (0=LSB, 2=MSB)
+	for(udword j=0;j<3;j++)
+	{
+		const udword Shift = j*11;
+		udword* CurCount = &mHistogram[j*RADIX11_SIZE];
+
+		// If all values have the same digit, sorting is useless
+		const udword UniqueVal = (input[0]>>Shift) & RADIX11_MASK;
+		const bool PerformPass = CurCount[UniqueVal]!=nb;
+
+		if(j!=2 || type==RADIX_UNSIGNED)
+		{
+			if(!PerformPass)
+				continue;
+
+			// Create offsets
+			const udword NbDigits = j!=2 ? RADIX11_SIZE : RADIX11_LAST_SIZE;
+			mOffset[0] = 0;
+			for(udword i=1;i<NbDigits;i++)	mOffset[i] = mOffset[i-1] + CurCount[i-1];
+		}
+		else if(type==RADIX_SIGNED)
+		{
+			if(!PerformPass)
+				continue;
+
+			// Negative integers are sorted in the right order but at the wrong place
+			mOffset[0] = NbNegativeValues;
+			for(udword i=1;i<RADIX11_NEGATIVE;i++)						mOffset[i] = mOffset[i-1] + CurCount[i-1];
+			mOffset[RADIX11_NEGATIVE] = 0;
+			for(udword i=RADIX11_NEGATIVE+1;i<RADIX11_LAST_SIZE;i++)	mOffset[i] = mOffset[i-1] + CurCount[i-1];
+		}
+		else
+		{
+			if(PerformPass)
+			{
+				// Create biased offsets, and reverse the sorting order for negative numbers
+				mOffset[0] = NbNegativeValues;
+				for(udword i=1;i<RADIX11_NEGATIVE;i++)		mOffset[i] = mOffset[i-1] + CurCount[i-1];
+				mOffset[RADIX11_LAST_SIZE-1] = 0;
+				for(udword i=RADIX11_LAST_SIZE-1;i>RADIX11_NEGATIVE;i--)		mOffset[i-1] = mOffset[i] + CurCount[i];
+				for(udword i=RADIX11_NEGATIVE;i<RADIX11_LAST_SIZE;i++)			mOffset[i] += CurCount[i];
+
+				if(INVALID_RANKS)
+				{
+					for(udword i=0;i<nb;i++)
+					{
+						const udword Radix = input[i]>>22;
+						if(Radix<RADIX11_NEGATIVE)	mRanks2[mOffset[Radix]++] = i;		// Number is positive
+						else						mRanks2[--mOffset[Radix]] = i;		// Number is negative, flip the sorting order
+					}
+					VALIDATE_RANKS;
+				}
+				else
+				{
+					for(udword i=0;i<nb;i++)
+					{
+						const udword id = mRanks[i];
+						const udword Radix = input[id]>>22;
+						if(Radix<RADIX11_NEGATIVE)	mRanks2[mOffset[Radix]++] = id;		// Number is positive
+						else						mRanks2[--mOffset[Radix]] = id;		// Number is negative, flip the sorting order
+					}
+				}
+			}
+			else
+			{
+				// The pass is useless, yet we still have to reverse the order of current list if all values are negative
+				if(UniqueVal<RADIX11_NEGATIVE)
+					continue;
+
+				if(INVALID_RANKS)
+				{
+					for(udword i=0;i<nb;i++)	mRanks2[i] = nb-i-1;
+					VALIDATE_RANKS;
+				}
+				else
+				{
+					for(udword i=0;i<nb;i++)	mRanks2[i] = mRanks[nb-i-1];
+				}
+			}
+
+			// Swap pointers for next pass. Valid indices - the most recent ones - are in mRanks after the swap.
+			udword* Tmp	= mRanks;	mRanks = mRanks2; mRanks2 = Tmp;
+			continue;
+		}
+
+		// Perform Radix Sort
+		if(INVALID_RANKS)
+		{
+			for(udword i=0;i<nb;i++)	mRanks2[mOffset[(input[i]>>Shift) & RADIX11_MASK]++] = i;
+			VALIDATE_RANKS;
+		}
+		else
+		{
+			udword* Indices		= mRanks;
+			udword* IndicesEnd	= &mRanks[nb];
+			while(Indices!=IndicesEnd)
+			{
+				udword id = *Indices++;
+				mRanks2[mOffset[(input[id]>>Shift) & RADIX11_MASK]++] = id;
+			}
+		}
+
+		// Swap pointers for next pass. Valid indices - the most recent ones - are in mRanks after the swap.
+		udword* Tmp	= mRanks;	mRanks = mRanks2; mRanks2 = Tmp;
+	}
+	return *this;
+}
+
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 /**
  *	Gets the ram used.
@@ -486,9 +924,10 @@ udword RadixSort::GetUsedRam() const
 {
 	udword UsedRam = sizeof(RadixSort);
 #ifndef RADIX_LOCAL_RAM
-	UsedRam += 256*4*sizeof(udword);			// Histograms
-	UsedRam += 256*sizeof(udword);				// Offsets
+	UsedRam += RADIX11_SIZE*3*sizeof(udword);	// Histograms
+	UsedRam += RADIX11_SIZE*sizeof(udword);		// Offsets
 #endif
-	UsedRam += 2*CURRENT_SIZE*sizeof(udword);	// 2 lists of indices
+	UsedRam += 2*(CURRENT_SIZE+RADIX_RANKS_SLACK)*sizeof(udword);	// 2 lists of indices
+	UsedRam += mKeysSize*sizeof(udword);		// Integer keys
 	return UsedRam;
 }
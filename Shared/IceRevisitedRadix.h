@@ -14,6 +14,21 @@
 
 	#define RADIX_LOCAL_RAM
 
+	//! Inputs of at least this size are sorted with 11-bit digits in RADIX_AUTO mode
+	#define RADIX_11_BITS_THRESHOLD	100000
+	//! Extra entries at the end of the ranks lists, so that users can read them 4 at a time
+	#define RADIX_RANKS_SLACK	4
+
+	enum RadixSortMode
+	{
+		RADIX_8_BITS,		//!< 4 passes with 8-bit digits, 256-entry histograms
+		RADIX_11_BITS,		//!< 3 passes with 11-bit digits, 2048-entry histograms. One less pass over memory, bigger histograms.
+		RADIX_AUTO,			//!< 11 bits for large inputs, 8 bits otherwise
+		RADIX_KEY_RANGE,	//!< Only sorts the significant bits of the key range, in 1 to 3 passes. Strided float version only, else same as RADIX_AUTO.
+
+		RADIX_FORCE_DWORD	= 0x7fffffff
+	};
+
 	class ICECORE_API RadixSort
 	{
 		public:
@@ -23,6 +38,11 @@
 		// Sorting methods
 				RadixSort&		Sort(const udword* input, udword nb, bool signedvalues=true);
 				RadixSort&		Sort(const float* input, udword nb);
+				RadixSort&		Sort(const float* input, udword nb, udword stride);
+
+		//! Digit size selection. All modes produce the same ranks. The default is RADIX_8_BITS, i.e. the original sorter.
+		inline_	void			SetMode(RadixSortMode mode)	{ mMode = mode;			}
+		inline_	RadixSortMode	GetMode()			const	{ return mMode;			}
 
 		//! Access to results. mRanks is a list of indices in sorted order, i.e. in the order you may further process your data
 		inline_	udword*			GetRanks()			const	{ return mRanks;		}
@@ -30,6 +50,9 @@
 		//! mIndices2 gets trashed on calling the sort routine, but otherwise you can recycle it the way you want.
 		inline_	udword*			GetRecyclable()		const	{ return mRanks2;		}
 
+		// Starting order of the next call, which normally is the previous sorted order
+				void			SetRanks(const udword* ranks, udword nb);
+
 		// Stats
 				udword			GetUsedRam()		const;
 		//! Returns the total number of calls to the radix sorter.
@@ -46,12 +69,18 @@
 				udword			mCurrentSize;		//!< Current size of the indices list
 				udword*			mRanks;				//!< Two lists, swapped each pass
 				udword*			mRanks2;
+				udword*			mKeys;				//!< Integer keys for the strided float version
+				udword			mKeysSize;
 		// Stats
 				udword			mTotalCalls;
 				udword			mNbHits;
+		// Settings
+				RadixSortMode	mMode;
 		// Internal methods
 				void			CheckResize(udword nb);
 				bool			Resize(udword nb);
+		inline_	bool			Use11Bits(udword nb)	const	{ return mMode==RADIX_11_BITS || (mMode!=RADIX_8_BITS && nb>=RADIX_11_BITS_THRESHOLD);	}
+				RadixSort&		Sort11Bits(const udword* input, udword nb, udword type);
 	};
 
 #endif // __ICERADIXSORT_H__
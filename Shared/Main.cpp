@@ -517,6 +517,13 @@ static void RunValidityTest()
 }
 #endif
 
+#ifdef USE_EXTENDED_VALIDITY_TESTS
+void RunExtendedValidityTests();
+#endif
+#ifdef USE_COHERENT_SORT_TEST
+void RunCoherentSortTest();
+#endif
+
 /*static void RunEdgeCase()
 {
 	Container Pairs;
@@ -535,8 +542,16 @@ int main(int argc, char* argv[])
 	bool ProfilingMode = true;
 
 	RunPerformanceTest(ProfilingMode);
+#ifdef USE_COHERENT_SORT_TEST
+	RunCoherentSortTest();
+#endif
 	if (!ProfilingMode)
+	{
 		RunValidityTest();
+#ifdef USE_EXTENDED_VALIDITY_TESTS
+		RunExtendedValidityTests();
+#endif
+	}
 //	RunEdgeCase();
 
 	//while(!_kbhit());